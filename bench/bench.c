@@ -0,0 +1,776 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+// Benchmark driver: runs bf --timing over the example programs and a set
+// of generated stress programs in each mode, and reports the median and
+// p95 of every phase as JSON. Every run's output must match a reference
+// run of the unoptimized interpreter, so a miscompile fails the suite.
+// With --baseline, compares compile time, code size and execution time
+// against an earlier report.
+
+#define MAX_REPEAT 1000
+#define MAX_PHASES 64
+#define MAX_RESULTS 256
+
+// Phases of bf --timing that make up compile time
+static const char *compile_phases[] = {
+    "Parsing", "AST Optimization", "Partial Evaluation", "JIT Compilation",
+};
+#define EXECUTION_PHASE "Program Execution"
+
+typedef struct {
+    const char *name;
+    const char *flags;          // Extra bf arguments, space separated
+} bench_mode_t;
+
+static const bench_mode_t modes[] = {
+    { "default", "" },
+    { "unsafe", "--unsafe" },
+    { "no-optimize", "--no-optimize" },
+    { "lazy", "--lazy" },
+    { "tier-auto", "--tier=auto" },
+};
+
+// Produces the expected output: no rewrites and no generated code
+static const bench_mode_t reference_mode = { "reference", "--no-optimize --tier=interp" };
+
+typedef struct {
+    char name[32];
+    char program[4096];         // Path to the .b file
+    char input[4096];           // Path to stdin contents, or "" for /dev/null
+    char flags[64];             // bf arguments every mode adds, space separated
+    bool safe_only;             // Relies on the masked tape, so skips --unsafe
+    char expected[4096];        // Output of the reference run
+    char output[4096];          // Output of the latest run
+} bench_program_t;
+
+typedef struct {
+    char name[40];
+    double samples[MAX_REPEAT];
+    int count;
+} bench_phase_t;
+
+typedef struct {
+    double median;
+    double p95;
+} bench_stat_t;
+
+typedef struct {
+    char program[32];
+    char mode[32];
+    long code_size;
+    bench_stat_t compile;
+    bench_stat_t execution;
+} bench_result_t;
+
+static void bench_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n", msg);
+    exit(1);
+}
+
+// bazel run executes from the runfiles tree; resolve user paths against
+// the directory the command was started in
+static const char *user_path(const char *path, char *buf, size_t size) {
+    const char *cwd = getenv("BUILD_WORKING_DIRECTORY");
+    if (!cwd || path[0] == '/') return path;
+    snprintf(buf, size, "%s/%s", cwd, path);
+    return buf;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Nearest-rank percentiles over a copy of the samples
+static bench_stat_t summarize(const double *samples, int count) {
+    bench_stat_t stat = { 0.0, 0.0 };
+    if (count == 0) return stat;
+
+    double sorted[MAX_REPEAT];
+    memcpy(sorted, samples, (size_t)count * sizeof(double));
+    qsort(sorted, (size_t)count, sizeof(double), compare_double);
+
+    stat.median = count % 2 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2.0;
+    int rank = (95 * count + 99) / 100;
+    stat.p95 = sorted[rank > 0 ? rank - 1 : 0];
+    return stat;
+}
+
+// Stress program generators. Each reads its repeat counts from stdin so
+// partial evaluation cannot fold the measured work into compile time.
+
+static FILE *open_output(const char *path) {
+    FILE *file = fopen(path, "w");
+    if (!file) {
+        perror(path);
+        exit(1);
+    }
+    return file;
+}
+
+// Deeply nested loops: the first levels run twice, the rest once
+static void generate_nesting(FILE *out, FILE *input, int scale) {
+    int depth = 64 * scale;
+    fputs(",[>", out);
+    for (int i = 0; i < depth; i++) {
+        fputs(i < 12 ? "++[>" : "+[>", out);
+    }
+    fputc('+', out);
+    for (int i = 0; i < depth; i++) {
+        fputs("<-]", out);
+    }
+    fputs("<,]", out);
+    for (int i = 0; i < 16; i++) fputc(1, input);
+}
+
+// Long loop-free runs of arithmetic and pointer movement
+static void generate_flat(FILE *out, FILE *input, int scale) {
+    unsigned int seed = 12345;
+    int pos = 0;
+    fputs(",[>", out);
+    for (int i = 0; i < 200000 * scale; i++) {
+        seed = seed * 1103515245u + 12345u;
+        int r = (int)((seed >> 16) % 4);
+        if (r == 2 && pos < 255) {
+            fputc('>', out);
+            pos++;
+        } else if (r == 3 && pos > 0) {
+            fputc('<', out);
+            pos--;
+        } else {
+            fputc(r == 1 ? '-' : '+', out);
+        }
+    }
+    for (; pos > 0; pos--) fputc('<', out);
+    fputs("<,]", out);
+    for (int i = 0; i < 64; i++) fputc(1, input);
+}
+
+// Back-and-forth scans over a run of non-zero cells (cell 0 is the
+// left sentinel, cell 1 the round counter)
+static void generate_scan(FILE *out, FILE *input, int scale) {
+    int cells = 50000;
+    fputs(">>", out);
+    for (int i = 0; i < cells; i++) fputs("+>", out);
+    for (int i = 0; i < cells + 1; i++) fputc('<', out);
+    for (int i = 0; i < scale; i++) {
+        fputs(",[>[>]<[<]>-]", out);
+        fputc(200, input);
+    }
+}
+
+// cat: one byte in, one byte out
+static void generate_io(FILE *out, FILE *input, int scale) {
+    fputs(",[.,]", out);
+    unsigned int seed = 54321;
+    for (long i = 0; i < 4L * 1024 * 1024 * scale; i++) {
+        seed = seed * 1103515245u + 12345u;
+        fputc(' ' + (int)((seed >> 16) % 95), input);
+    }
+}
+
+// Edge-case programs. They are too small to time usefully; they are here
+// so every mode is checked against the reference where the code generator
+// takes its special paths. scale does not apply.
+
+static void put_repeat(FILE *out, int c, int count) {
+    for (int i = 0; i < count; i++) fputc(c, out);
+}
+
+// Runs of adjacent cells: constant adds, clear-and-set, and one multiply
+// loop with a target in every cell. The input byte is the loop count.
+static void generate_edge_vector(FILE *out, FILE *input, int scale) {
+    (void)scale;
+    int cells = 40;
+    fputs(",>", out);
+    for (int i = 0; i < cells; i++) {
+        put_repeat(out, '+', i % 13 + 1);
+        fputc('>', out);
+    }
+    put_repeat(out, '<', cells + 1);
+    fputs("[-", out);
+    for (int i = 0; i < cells; i++) {
+        int factor = i % 7 - 3;
+        fputc('>', out);
+        put_repeat(out, factor < 0 ? '-' : '+', factor < 0 ? -factor : factor + 1);
+    }
+    put_repeat(out, '<', cells);
+    fputs("]>", out);
+    for (int i = 0; i < cells; i++) fputs(".>", out);
+    put_repeat(out, '<', cells);
+    for (int i = 0; i < cells; i++) {
+        fputs("[-]", out);
+        put_repeat(out, '+', i * 5 % 11);
+        fputc('>', out);
+    }
+    put_repeat(out, '<', cells);
+    for (int i = 0; i < cells; i++) fputs(".>", out);
+    fputc(5, input);
+}
+
+// Forward and backward scans of each stride over cells that straddle a
+// page boundary, then over the first and last cells of the default unsafe
+// tape. Cells are read from input so the scans cannot be folded. The
+// regions stay apart modulo the masked tape, so safe and unsafe runs agree.
+static void generate_edge_scan(FILE *out, FILE *input, int scale) {
+    (void)scale;
+    static const int strides[] = { 1, 2, 3, 4, 8, 16 };
+    int count = 24;
+    int pos = 0;
+    for (size_t i = 0; i < sizeof(strides) / sizeof(strides[0]); i++) {
+        int stride = strides[i];
+        int base = 4096 * (int)(i + 1) - count / 2 * stride;
+        put_repeat(out, base > pos ? '>' : '<', abs(base - pos));
+        for (int k = 0; k < count; k++) {
+            fputc(',', out);
+            put_repeat(out, '>', stride);
+            fputc(1 + (k * 37 + (int)i) % 255, input);
+        }
+        put_repeat(out, '<', count * stride);
+        fputc('[', out);
+        put_repeat(out, '>', stride);
+        fputc(']', out);
+        put_repeat(out, '+', 'A' + (int)i);
+        fputc('.', out);
+        put_repeat(out, '<', stride);
+        fputc('[', out);
+        put_repeat(out, '<', stride);
+        fputc(']', out);
+        put_repeat(out, '+', 'a' + (int)i);
+        fputc('.', out);
+        pos = base - stride;
+    }
+
+    // The default unsafe tape spans cells -4096 to 61439; both stay zero
+    int edges[] = { 61439 - count, -4096 + 1 };
+    for (int e = 0; e < 2; e++) {
+        put_repeat(out, edges[e] > pos ? '>' : '<', abs(edges[e] - pos));
+        for (int k = 0; k < count; k++) {
+            fputs(",>", out);
+            fputc(1 + k, input);
+        }
+        if (e == 0) {
+            put_repeat(out, '<', count);
+            fputs("[>]+.", out);
+            pos = edges[e] + count;
+        } else {
+            fputs("<[<]+.", out);
+            pos = edges[e] - 1;
+        }
+    }
+}
+
+// A tape of 8192 cells: arithmetic blocks across the wrap, offsets that
+// alias the same cell in one block, and scans that wrap both ways
+static void generate_edge_wrap(FILE *out, FILE *input, int scale) {
+    (void)scale;
+    int size = 8192;
+    fputc(',', out);
+    put_repeat(out, '<', 2);
+    fputs("+>++>+++>++++<<<.>.>.>.<<<", out);
+    put_repeat(out, '>', size + 3);
+    fputs("++", out);
+    put_repeat(out, '<', size);
+    fputs(".>", out);
+    put_repeat(out, '>', 2 * size);
+    fputs("---", out);
+    put_repeat(out, '<', 2 * size + 1);
+    fputs(".>.<", out);
+    fputs("[->", out);
+    put_repeat(out, '>', size);
+    fputs("+<", out);
+    put_repeat(out, '<', size);
+    fputs("]>.", out);
+
+    put_repeat(out, '<', 21);
+    for (int k = 0; k < 24; k++) fputs(",>", out);
+    put_repeat(out, '<', 24);
+    fputs("[>]+.[<]+.", out);
+    put_repeat(out, '>', 3);
+    fputs("[>>>]+.", out);
+
+    // Unoptimized, each side is two accesses the cell cache could keep
+    fputs("++", out);
+    put_repeat(out, '>', size);
+    fputs("++", out);
+    put_repeat(out, '<', size);
+    fputc('.', out);
+    fputc(3, input);
+    for (int k = 0; k < 24; k++) fputc(1 + k, input);
+}
+
+// Cells changed in a block and then written, read or read past EOF, with
+// the block continuing after the I/O
+static void generate_edge_eof(FILE *out, FILE *input, int scale) {
+    (void)scale;
+    fputs("+++>++>+<<.>.>.<<", out);
+    fputs(">+++<,>+<.>.<", out);
+    fputs(",.+.>,.<.>>,.+++.-.<<", out);
+    fputs("++++[>++>+<<.>.>.<<-]", out);
+    fputs("A", input);
+}
+
+typedef void (*bench_generator_t)(FILE *out, FILE *input, int scale);
+
+static const struct {
+    const char *name;
+    bench_generator_t generate;
+    const char *flags;
+    bool safe_only;
+} generators[] = {
+    { "stress-nesting", generate_nesting, "", false },
+    { "stress-flat", generate_flat, "", false },
+    { "stress-scan", generate_scan, "", false },
+    { "stress-io", generate_io, "", false },
+    { "edge-vector", generate_edge_vector, "", false },
+    { "edge-scan", generate_edge_scan, "", false },
+    { "edge-wrap", generate_edge_wrap, "--memory 8192 --memory-offset 0", true },
+    { "edge-eof-zero", generate_edge_eof, "--eof 0", false },
+    { "edge-eof-minus", generate_edge_eof, "--eof -1", false },
+    { "edge-eof-keep", generate_edge_eof, "--eof unchanged", false },
+};
+
+static const char *example_programs[] = { "mandelbrot", "long", "fizzbuzz", "quine" };
+
+// Run bf once with stdout in output_path and collect its --timing phases
+// and code size. Returns 0 on success, -1 if bf could not be run or failed.
+static int run_once(const char *bf, const bench_mode_t *mode, const bench_program_t *program,
+                    const char *output_path, bench_phase_t *phases, int *phase_count, long *code_size) {
+    int pipefd[2];
+    if (pipe(pipefd) != 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        close(pipefd[0]);
+        close(pipefd[1]);
+        return -1;
+    }
+
+    if (pid == 0) {
+        int in = open(program->input[0] ? program->input : "/dev/null", O_RDONLY);
+        int output = open(output_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (in < 0 || output < 0) _exit(127);
+        dup2(in, STDIN_FILENO);
+        dup2(output, STDOUT_FILENO);
+        dup2(pipefd[1], STDERR_FILENO);
+        close(pipefd[0]);
+
+        char flags[384];
+        char *args[24];
+        int n = 0;
+        args[n++] = (char *)bf;
+        args[n++] = "--timing";
+        snprintf(flags, sizeof(flags), "%s %s", mode->flags, program->flags);
+        for (char *tok = strtok(flags, " "); tok && n < 22; tok = strtok(NULL, " ")) {
+            args[n++] = tok;
+        }
+        args[n++] = (char *)program->program;
+        args[n] = NULL;
+        execv(bf, args);
+        _exit(127);
+    }
+
+    close(pipefd[1]);
+    FILE *err = fdopen(pipefd[0], "r");
+    if (!err) {
+        close(pipefd[0]);
+        waitpid(pid, NULL, 0);
+        return -1;
+    }
+
+    char line[256];
+    while (fgets(line, sizeof(line), err)) {
+        char *colon = strrchr(line, ':');
+        if (!colon) continue;
+
+        // Per-pass times are indented under "AST Optimization"
+        char name[40];
+        const char *start = line;
+        bool pass = line[0] == ' ';
+        while (*start == ' ') start++;
+        int len = (int)(colon - start);
+        while (len > 0 && start[len - 1] == ' ') len--;
+        snprintf(name, sizeof(name), "%s%.*s", pass ? "pass " : "", len, start);
+
+        double value;
+        char unit[16];
+        if (sscanf(colon + 1, "%lf %15s", &value, unit) != 2) continue;
+
+        if (strcmp(unit, "bytes") == 0) {
+            *code_size = (long)value;
+            continue;
+        }
+        if (strcmp(unit, "ms") != 0) continue;
+
+        int p;
+        for (p = 0; p < *phase_count; p++) {
+            if (strcmp(phases[p].name, name) == 0) break;
+        }
+        if (p == *phase_count) {
+            if (*phase_count == MAX_PHASES) continue;
+            snprintf(phases[p].name, sizeof(phases[p].name), "%s", name);
+            phases[p].count = 0;
+            (*phase_count)++;
+        }
+        if (phases[p].count < MAX_REPEAT) {
+            phases[p].samples[phases[p].count++] = value;
+        }
+    }
+    fclose(err);
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// Byte-for-byte comparison of two files; false if either cannot be read
+static bool same_output(const char *path_a, const char *path_b) {
+    FILE *a = fopen(path_a, "rb");
+    FILE *b = fopen(path_b, "rb");
+    bool same = a && b;
+
+    char buf_a[65536], buf_b[65536];
+    while (same) {
+        size_t n = fread(buf_a, 1, sizeof(buf_a), a);
+        same = fread(buf_b, 1, sizeof(buf_b), b) == n && memcmp(buf_a, buf_b, n) == 0;
+        if (n < sizeof(buf_a)) break;
+    }
+    same = same && !ferror(a) && !ferror(b);
+
+    if (a) fclose(a);
+    if (b) fclose(b);
+    return same;
+}
+
+// Write the program's expected output. Returns 0, or -1 if the reference
+// run failed.
+static int run_reference(const char *bf, const bench_program_t *program) {
+    static bench_phase_t phases[MAX_PHASES];
+    int phase_count = 0;
+    long code_size = -1;
+    return run_once(bf, &reference_mode, program, program->expected, phases, &phase_count, &code_size);
+}
+
+static double phase_sample(const bench_phase_t *phases, int phase_count, const char *name, int run) {
+    for (int p = 0; p < phase_count; p++) {
+        if (strcmp(phases[p].name, name) == 0) {
+            return run < phases[p].count ? phases[p].samples[run] : 0.0;
+        }
+    }
+    return 0.0;
+}
+
+static void print_stat(FILE *out, bench_stat_t stat) {
+    fprintf(out, "{\"median\": %.3f, \"p95\": %.3f}", stat.median, stat.p95);
+}
+
+// One result per line, so baselines can be read back without a JSON parser
+static int run_benchmark(const char *bf, const bench_program_t *program, const bench_mode_t *mode,
+                         int repeat, bench_result_t *result, FILE *out, bool first) {
+    static bench_phase_t phases[MAX_PHASES];
+    int phase_count = 0;
+    long code_size = -1;
+
+    fprintf(stderr, "  %-16s %-12s", program->name, mode->name);
+    for (int r = 0; r < repeat; r++) {
+        if (run_once(bf, mode, program, program->output, phases, &phase_count, &code_size) != 0) {
+            fprintf(stderr, " failed\n");
+            return -1;
+        }
+        if (!same_output(program->output, program->expected)) {
+            fprintf(stderr, " output differs from %s\n", reference_mode.flags);
+            return -1;
+        }
+    }
+
+    double compile[MAX_REPEAT];
+    double execution[MAX_REPEAT];
+    for (int r = 0; r < repeat; r++) {
+        compile[r] = 0.0;
+        for (size_t c = 0; c < sizeof(compile_phases) / sizeof(compile_phases[0]); c++) {
+            compile[r] += phase_sample(phases, phase_count, compile_phases[c], r);
+        }
+        execution[r] = phase_sample(phases, phase_count, EXECUTION_PHASE, r);
+    }
+
+    snprintf(result->program, sizeof(result->program), "%.31s", program->name);
+    snprintf(result->mode, sizeof(result->mode), "%s", mode->name);
+    result->code_size = code_size;
+    result->compile = summarize(compile, repeat);
+    result->execution = summarize(execution, repeat);
+    fprintf(stderr, " compile %8.3f ms  exec %9.3f ms  code %ld bytes\n",
+            result->compile.median, result->execution.median, code_size);
+
+    fprintf(out, "%s    {\"program\": \"%s\", \"mode\": \"%s\", \"runs\": %d, \"code_size\": %ld, \"compile_ms\": ",
+            first ? "" : ",\n", result->program, result->mode, repeat, code_size);
+    print_stat(out, result->compile);
+    fprintf(out, ", \"execution_ms\": ");
+    print_stat(out, result->execution);
+    fprintf(out, ", \"phases\": {");
+    for (int p = 0; p < phase_count; p++) {
+        fprintf(out, "%s\"%s\": ", p ? ", " : "", phases[p].name);
+        print_stat(out, summarize(phases[p].samples, phases[p].count));
+    }
+    fprintf(out, "}}");
+    return 0;
+}
+
+static bool json_string(const char *line, const char *key, char *value, size_t size) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": \"", key);
+    const char *start = strstr(line, pattern);
+    if (!start) return false;
+    start += strlen(pattern);
+    const char *end = strchr(start, '"');
+    if (!end || (size_t)(end - start) >= size) return false;
+    memcpy(value, start, (size_t)(end - start));
+    value[end - start] = '\0';
+    return true;
+}
+
+static bool json_number(const char *line, const char *key, double *value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": ", key);
+    const char *start = strstr(line, pattern);
+    return start && sscanf(start + strlen(pattern), "%lf", value) == 1;
+}
+
+static bool json_median(const char *line, const char *key, double *value) {
+    char pattern[64];
+    snprintf(pattern, sizeof(pattern), "\"%s\": {\"median\": ", key);
+    const char *start = strstr(line, pattern);
+    return start && sscanf(start + strlen(pattern), "%lf", value) == 1;
+}
+
+static int load_baseline(const char *path, bench_result_t *results, int max) {
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    int count = 0;
+    char line[8192];
+    while (count < max && fgets(line, sizeof(line), file)) {
+        bench_result_t *result = &results[count];
+        double code_size;
+        if (json_string(line, "program", result->program, sizeof(result->program)) &&
+            json_string(line, "mode", result->mode, sizeof(result->mode)) &&
+            json_number(line, "code_size", &code_size) &&
+            json_median(line, "compile_ms", &result->compile.median) &&
+            json_median(line, "execution_ms", &result->execution.median)) {
+            result->code_size = (long)code_size;
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+// A time regresses when it grows by more than threshold percent and by at
+// least min_ms, so sub-millisecond noise on tiny programs is not flagged
+static bool time_regressed(double base, double current, double threshold, double min_ms) {
+    return current - base >= min_ms && current > base * (1.0 + threshold / 100.0);
+}
+
+static int compare_results(const bench_result_t *base, int base_count,
+                           const bench_result_t *current, int current_count,
+                           double threshold, double min_ms) {
+    int regressions = 0;
+    fprintf(stderr, "\n%-16s %-12s %-10s %12s %12s %8s\n", "program", "mode", "metric", "baseline", "current", "change");
+    for (int i = 0; i < current_count; i++) {
+        const bench_result_t *cur = &current[i];
+        const bench_result_t *old = NULL;
+        for (int j = 0; j < base_count; j++) {
+            if (strcmp(base[j].program, cur->program) == 0 && strcmp(base[j].mode, cur->mode) == 0) {
+                old = &base[j];
+                break;
+            }
+        }
+        if (!old) continue;
+
+        struct {
+            const char *metric;
+            double base, current;
+            bool regressed;
+        } rows[] = {
+            { "compile", old->compile.median, cur->compile.median,
+              time_regressed(old->compile.median, cur->compile.median, threshold, min_ms) },
+            { "execution", old->execution.median, cur->execution.median,
+              time_regressed(old->execution.median, cur->execution.median, threshold, min_ms) },
+            { "code size", (double)old->code_size, (double)cur->code_size,
+              old->code_size >= 0 && cur->code_size > old->code_size },
+        };
+        for (size_t r = 0; r < sizeof(rows) / sizeof(rows[0]); r++) {
+            double change = rows[r].base > 0 ? (rows[r].current / rows[r].base - 1.0) * 100.0 : 0.0;
+            fprintf(stderr, "%-16s %-12s %-10s %12.3f %12.3f %+7.1f%%%s\n", cur->program, cur->mode,
+                    rows[r].metric, rows[r].base, rows[r].current, change,
+                    rows[r].regressed ? "  REGRESSION" : "");
+            if (rows[r].regressed) regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void print_usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [options]\n", prog);
+    fprintf(stderr, "Options:\n");
+    fprintf(stderr, "  --bf path         bf binary to benchmark (default: ./bf)\n");
+    fprintf(stderr, "  --examples dir    Directory with the example programs (default: examples)\n");
+    fprintf(stderr, "  --repeat n        Runs per program and mode (default: 5)\n");
+    fprintf(stderr, "  --scale n         Size factor for the generated stress programs (default: 1)\n");
+    fprintf(stderr, "  --filter text     Only run programs whose name contains text\n");
+    fprintf(stderr, "  --out file        Write the JSON report to file (default: stdout)\n");
+    fprintf(stderr, "  --baseline file   Compare against an earlier report; exit 1 on regressions\n");
+    fprintf(stderr, "  --threshold pct   Time growth that counts as a regression (default: 10)\n");
+    fprintf(stderr, "  --min-ms ms       Ignore time growth smaller than this (default: 1)\n");
+}
+
+int main(int argc, char *argv[]) {
+    const char *bf = "./bf";
+    const char *examples = "examples";
+    const char *filter = NULL;
+    const char *out_path = NULL;
+    const char *baseline_path = NULL;
+    int repeat = 5;
+    int scale = 1;
+    double threshold = 10.0;
+    double min_ms = 1.0;
+    char out_buf[4096], baseline_buf[4096];
+
+    for (int i = 1; i < argc; i++) {
+        bool has_value = i + 1 < argc;
+        if (strcmp(argv[i], "--bf") == 0 && has_value) {
+            bf = argv[++i];
+        } else if (strcmp(argv[i], "--examples") == 0 && has_value) {
+            examples = argv[++i];
+        } else if (strcmp(argv[i], "--repeat") == 0 && has_value) {
+            repeat = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--scale") == 0 && has_value) {
+            scale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--filter") == 0 && has_value) {
+            filter = argv[++i];
+        } else if (strcmp(argv[i], "--out") == 0 && has_value) {
+            out_path = user_path(argv[++i], out_buf, sizeof(out_buf));
+        } else if (strcmp(argv[i], "--baseline") == 0 && has_value) {
+            baseline_path = user_path(argv[++i], baseline_buf, sizeof(baseline_buf));
+        } else if (strcmp(argv[i], "--threshold") == 0 && has_value) {
+            threshold = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--min-ms") == 0 && has_value) {
+            min_ms = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--help") == 0) {
+            print_usage(argv[0]);
+            return 0;
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (repeat < 1 || repeat > MAX_REPEAT) bench_error("--repeat must be between 1 and 1000");
+    if (scale < 1) bench_error("--scale must be at least 1");
+
+    static bench_result_t baseline[MAX_RESULTS];
+    int baseline_count = 0;
+    if (baseline_path) {
+        baseline_count = load_baseline(baseline_path, baseline, MAX_RESULTS);
+        if (baseline_count < 0) {
+            fprintf(stderr, "Error: Could not read baseline '%s'\n", baseline_path);
+            return 1;
+        }
+    }
+
+    char tmpdir[] = "/tmp/bf-bench-XXXXXX";
+    if (!mkdtemp(tmpdir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    static bench_program_t programs[MAX_RESULTS];
+    int program_count = 0;
+    for (size_t i = 0; i < sizeof(example_programs) / sizeof(example_programs[0]); i++) {
+        bench_program_t *program = &programs[program_count++];
+        snprintf(program->name, sizeof(program->name), "%s", example_programs[i]);
+        snprintf(program->program, sizeof(program->program), "%s/%s.b", examples, example_programs[i]);
+        program->input[0] = '\0';
+        program->flags[0] = '\0';
+        program->safe_only = false;
+    }
+    for (size_t i = 0; i < sizeof(generators) / sizeof(generators[0]); i++) {
+        bench_program_t *program = &programs[program_count++];
+        snprintf(program->name, sizeof(program->name), "%s", generators[i].name);
+        snprintf(program->program, sizeof(program->program), "%s/%s.b", tmpdir, generators[i].name);
+        snprintf(program->input, sizeof(program->input), "%s/%s.in", tmpdir, generators[i].name);
+        snprintf(program->flags, sizeof(program->flags), "%s", generators[i].flags);
+        program->safe_only = generators[i].safe_only;
+        FILE *source = open_output(program->program);
+        FILE *input = open_output(program->input);
+        generators[i].generate(source, input, scale);
+        fclose(source);
+        fclose(input);
+    }
+    for (int p = 0; p < program_count; p++) {
+        snprintf(programs[p].expected, sizeof(programs[p].expected), "%s/%s.expected", tmpdir, programs[p].name);
+        snprintf(programs[p].output, sizeof(programs[p].output), "%s/%s.out", tmpdir, programs[p].name);
+    }
+
+    FILE *out = out_path ? fopen(out_path, "w") : stdout;
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+
+    fprintf(stderr, "Benchmarking %s (%d runs, scale %d)\n", bf, repeat, scale);
+    fprintf(out, "{\n  \"bf\": \"%s\",\n  \"repeat\": %d,\n  \"scale\": %d,\n  \"results\": [\n", bf, repeat, scale);
+
+    static bench_result_t results[MAX_RESULTS];
+    int result_count = 0;
+    int failures = 0;
+    for (int p = 0; p < program_count; p++) {
+        if (filter && !strstr(programs[p].name, filter)) continue;
+        if (run_reference(bf, &programs[p]) != 0) {
+            fprintf(stderr, "  %-16s %-12s failed\n", programs[p].name, reference_mode.name);
+            failures++;
+            continue;
+        }
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]) && result_count < MAX_RESULTS; m++) {
+            if (programs[p].safe_only && strstr(modes[m].flags, "--unsafe")) continue;
+            if (run_benchmark(bf, &programs[p], &modes[m], repeat, &results[result_count], out,
+                              result_count == 0) == 0) {
+                result_count++;
+            } else {
+                failures++;
+            }
+        }
+    }
+    fprintf(out, "\n  ]\n}\n");
+    if (out != stdout) fclose(out);
+
+    for (int p = 0; p < program_count; p++) {
+        unlink(programs[p].expected);
+        unlink(programs[p].output);
+        if (programs[p].input[0]) {
+            unlink(programs[p].program);
+            unlink(programs[p].input);
+        }
+    }
+    rmdir(tmpdir);
+
+    int regressions = 0;
+    if (baseline_path) {
+        regressions = compare_results(baseline, baseline_count, results, result_count, threshold, min_ms);
+        fprintf(stderr, "\n%d regression%s\n", regressions, regressions == 1 ? "" : "s");
+    }
+    return failures > 0 || regressions > 0 ? 1 : 0;
+}
@@ -3,23 +3,28 @@
 #include <string.h>
 #include <stdint.h>
 #include <unistd.h>
-#include <sys/mman.h>
-#include <assert.h>
 #include <stdbool.h>
 #include <time.h>
+#include <fcntl.h>
 
-#include "dasm_proto.h"
+#include "bf_lib.h"
+#include "bf_codegen.h"
 #include "bf_ast.h"
 #include "bf_prof.h"
 #include "bf_debug.h"
-
-#include "bf_parser.h"
-
-#define BF_DEFAULT_MEMORY_SIZE 65536  // 64KB - nice power of 2
-#define MAX_NESTING 1000
-
-// Global flag to control unsafe mode (accessible by DynASM templates)
-static bool g_unsafe_mode = false;
+#include "bf_io.h"
+#include "bf_cache.h"
+#include "bf_peval.h"
+#include "bf_pgo.h"
+#include "bf_perf.h"
+#include "bf_count.h"
+#include "bf_batch.h"
+#include "bf_scan.h"
+#include "bf_interp.h"
+#include "bf_tape.h"
+#include "bf_stats.h"
+
+#define MAX_PASSES 64
 
 // High-resolution timing helpers
 static double get_time_ms(void) {
@@ -34,238 +39,73 @@ static void print_phase_time(const char *phase, double start_ms, double end_ms)
     fprintf(stderr, "%-20s: %8.3f ms\n", phase, end_ms - start_ms);
 }
 
-// Memory allocation with guard pages
-static char* allocate_guarded_memory(size_t size) {
-    // Get page size for alignment
-    size_t page_size = getpagesize();
-
-    // Round up size to page boundary
-    size_t aligned_size = (size + page_size - 1) & ~(page_size - 1);
-
-    // Allocate 3 regions: guard page + data + guard page
-    size_t total_size = page_size + aligned_size + page_size;
-
-    void *region = mmap(NULL, total_size, PROT_READ | PROT_WRITE,
-                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (region == MAP_FAILED) {
-        return NULL;
-    }
-
-    char *guard1 = (char*)region;
-    char *data = guard1 + page_size;
-    char *guard2 = data + aligned_size;
-
-    // Make guard pages inaccessible (no read/write/execute)
-    if (mprotect(guard1, page_size, PROT_NONE) != 0 ||
-        mprotect(guard2, page_size, PROT_NONE) != 0) {
-        munmap(region, total_size);
-        return NULL;
-    }
-
-    return data;
-}
-
-static void free_guarded_memory(char *memory, size_t size) {
-    if (!memory) return;
-
-    size_t page_size = getpagesize();
-    size_t aligned_size = (size + page_size - 1) & ~(page_size - 1);
-    size_t total_size = page_size + aligned_size + page_size;
-
-    // Find start of the full region (guard page before data)
-    char *region_start = memory - page_size;
-    munmap(region_start, total_size);
+// Close the phase that began at *phase_start: print it for --timing,
+// record it for --stats, and start the next one
+static void end_phase(const char *phase, double *phase_start, bool print, bf_stats_t *stats) {
+    double phase_end = get_time_ms();
+    if (print) print_phase_time(phase, *phase_start, phase_end);
+    if (stats) bf_stats_phase(stats, phase, phase_end - *phase_start);
+    *phase_start = phase_end;
 }
 
-typedef int (*bf_func)(char *memory);
-
-// Include architecture-specific generated C files based on target architecture
-#if defined(__x86_64__) || defined(__x86_64) || defined(__amd64__) || defined(__amd64)
-#include "dasm_x86.h"
-#include "bf_amd64.c"
-#elif defined(__aarch64__) || defined(__arm64__)
-#include "dasm_arm64.h"
-#include "bf_arm64.c"
-#else
-#error "Unsupported architecture"
-#endif
-
 static void bf_error(const char *msg) {
     fprintf(stderr, "Error: %s\n", msg);
     exit(1);
 }
 
-static char *read_file(const char *filename, size_t *size) {
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        bf_error("Could not open file");
-    }
-
-    fseek(file, 0, SEEK_END);
-    *size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    char *content = malloc(*size + 1);
-    if (!content) {
-        bf_error("Memory allocation failed");
-    }
-
-    fread(content, 1, *size, file);
-    content[*size] = '\0';
-    fclose(file);
-
-    return content;
-}
-
-static void dump_code_hex(void *code, size_t size) {
-    fprintf(stderr, "\nDumping %zu bytes of compiled machine code:\n", size);
-    unsigned char *bytes = (unsigned char *)code;
-    for (size_t i = 0; i < size; i++) {
-        if (i % 16 == 0) fprintf(stderr, "%08zx: ", i);
-        fprintf(stderr, "%02x ", bytes[i]);
-        if (i % 16 == 15) fprintf(stderr, "\n");
-    }
-    if (size % 16 != 0) fprintf(stderr, "\n");
-    fprintf(stderr, "\n");
-}
-
-static int ast_compile_direct(ast_node_t *node, dasm_State **Dst, int next_label, bf_debug_info_t *debug, int *debug_label, bool debug_mode) {
-    if (!node) return next_label;
-
-    if (debug && debug_label) {
-        int current_debug_label = (*debug_label)++;
-        bf_debug_add_mapping(debug, current_debug_label, node, node->line, node->column);
-        compile_bf_debug_label(Dst, current_debug_label);
-    }
-
-    switch (node->type) {
-        case AST_MOVE_PTR:
-            compile_bf_move_ptr(Dst, node->data.basic.count);
-            break;
-
-        case AST_ADD_VAL:
-            compile_bf_add_val(Dst, node->data.basic.count, node->data.basic.offset);
-            break;
-
-        case AST_OUTPUT:
-            compile_bf_output(Dst, node->data.basic.offset);
-            break;
-
-        case AST_INPUT:
-            compile_bf_input(Dst, node->data.basic.offset);
-            break;
-
-        case AST_LOOP: {
-            int start_label = next_label++;
-            int end_label = next_label++;
-            compile_bf_loop_start(Dst, end_label);
-            compile_bf_label(Dst, start_label);
-            next_label = ast_compile_direct(node->data.loop.body, Dst, next_label, debug, debug_label, debug_mode);
-            compile_bf_loop_end(Dst, start_label);
-            compile_bf_label(Dst, end_label);
-            break;
-        }
-
-
-        case AST_SET_CONST:
-            compile_bf_set_const(Dst, node->data.basic.count, node->data.basic.offset);
-            break;
-
-        case AST_MUL:
-            compile_bf_mul(Dst, node->data.mul.multiplier, node->data.mul.src_offset, node->data.mul.dst_offset);
-            break;
-
-        case AST_DEBUG_LOG:
-            compile_bf_debug_log(Dst, debug_mode, node->line, node->column);
-            break;
-    }
-
-    // Continue with next node
-    if (node->next) {
-        next_label = ast_compile_direct(node->next, Dst, next_label, debug, debug_label, debug_mode);
-    }
-
-    return next_label;
-}
-
-static bf_func compile_bf_ast(ast_node_t *ast, bool debug_mode, bool unsafe_mode, void **code_ptr, size_t *code_size, bf_debug_info_t *debug_info, size_t memory_size) {
-    g_unsafe_mode = unsafe_mode;  // Set global flag for DynASM templates
-
-    dasm_State *state = NULL;
-    dasm_State **Dst = &state;
-    dasm_init(Dst, 1);
-    dasm_setup(Dst, actions);
-
-    int debug_label_count = debug_info ? ast_count_nodes(ast) : 0;
-    dasm_growpc(Dst, MAX_NESTING * 2 + debug_label_count);
-
-    compile_bf_prologue(Dst, memory_size);
-
-    int debug_label_counter = MAX_NESTING * 2; // Start debug labels after loop labels
-    ast_compile_direct(ast, Dst, 0, debug_info, debug_info ? &debug_label_counter : NULL, debug_mode);
-
-    compile_bf_epilogue(Dst);
-
-    size_t size;
-    int ret = dasm_link(Dst, &size);
-    if (ret != 0) {
-        bf_error("DynASM linking failed");
-    }
-
-    void *code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
-    if (code == MAP_FAILED) {
-        bf_error("Memory mapping failed");
-    }
-
-    // Resolve debug labels BEFORE encoding - after this dasm_getpclabel corrupts state
-    if (debug_info) {
-        for (int i = 0; i < debug_info->entry_count; i++) {
-            debug_map_entry_t *entry = &debug_info->entries[i];
-            int32_t ofs = dasm_getpclabel(Dst, entry->pc_label);
-            if (ofs >= 0) {
-                entry->pc_offset = (size_t)ofs;
-            }
-        }
-    }
-
-    ret = dasm_encode(Dst, code);
-    if (ret != 0) {
-        bf_error("DynASM encoding failed");
-    }
-
-    if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
-        bf_error("Memory protection failed");
-    }
-
-    if (debug_mode) {
-        dump_code_hex(code, size);
-    }
-
-    if (code_ptr) *code_ptr = code;
-    if (code_size) *code_size = size;
-
-    dasm_free(Dst);
-    return (bf_func)code;
-}
-
-
 int main(int argc, char *argv[]) {
     bool debug_mode = false;
     bool optimize = true;
     bool show_help = false;
     bool profile_mode = false;
     bool timing_mode = false;
+    bool stats_mode = false;       // --stats=json
+    const char *stats_file = NULL; // --stats=json:file, NULL for stderr
+    bool perf_map = false;     // --perf-map
+    bool jitdump = false;      // --jitdump
+    bool gdb_jit = false;      // --gdb-jit
     bool unsafe_mode = false;  // Disable memory safety for performance
+    bf_eof_mode_t eof_mode = BF_EOF_ZERO;
     const char *profile_output = NULL;
+    int profile_hz = PROF_SAMPLE_RATE_HZ;
+    const char *cache_dir = NULL;
+    const char *pass_list = NULL;  // --passes, NULL for the default pipeline
+    const char *pgo_output = NULL;
+    bool count_mode = false;       // --count
+    bool count_nodes = false;      // --count=nodes
+    const char *count_json = NULL; // --count-json
+    const char *pgo_input = NULL;
+    long peval_steps = BF_PEVAL_DEFAULT_STEPS;
     size_t memory_size = BF_DEFAULT_MEMORY_SIZE;
-    size_t memory_offset = 4096;  // Default 4KB offset for negative access
+    size_t memory_offset = BF_DEFAULT_MEMORY_OFFSET;
+    bool memory_given = false;     // --memory, else the default for the tape kind
+    bool grow_tape = false;        // --tape=grow
+    bool hugepages = false;        // --hugepages
+    bf_tier_t tier = BF_TIER_JIT;  // --tier
+    bool lazy_mode = false;        // --lazy
+    bool code_arena = false;       // --code-arena
+    const char *input_file = NULL; // --input, mapped instead of reading stdin
+    bool splice_output = false;    // --splice-output
+    bool batch_mode = false;       // --batch
+    char batch_delimiter = '\n';   // --batch-nul
+    long batch_jobs = 0;           // --jobs, 0 for one per CPU
+    char **batch_inputs = malloc((size_t)argc * sizeof(char *));
+    int batch_count = 0;
     int arg_offset = -1;
 
+    if (!batch_inputs) {
+        perror("malloc");
+        return 1;
+    }
+
     for (int i = 1; i < argc; i++) {
         if (argv[i][0] != '-') {
-            // Non-flag argument, assume it's the filename
+            // Non-flag argument, assume it's the filename; any further ones
+            // are --batch inputs
             if (arg_offset == -1) {
                 arg_offset = i;
+            } else {
+                batch_inputs[batch_count++] = argv[i];
             }
             continue;
         }
@@ -273,10 +113,37 @@ int main(int argc, char *argv[]) {
             debug_mode = true;
         } else if (strcmp(argv[i], "--timing") == 0) {
             timing_mode = true;
+        } else if (strcmp(argv[i], "--stats=json") == 0) {
+            stats_mode = true;
+        } else if (strncmp(argv[i], "--stats=json:", 13) == 0 && argv[i][13] != '\0') {
+            stats_mode = true;
+            stats_file = argv[i] + 13;
+        } else if (strncmp(argv[i], "--stats", 7) == 0) {
+            fprintf(stderr, "Error: Invalid stats format '%s' (expected --stats=json[:file])\n", argv[i]);
+            return 1;
         } else if (strcmp(argv[i], "--no-optimize") == 0) {
             optimize = false;
         } else if (strcmp(argv[i], "--unsafe") == 0) {
             unsafe_mode = true;
+        } else if (strcmp(argv[i], "--perf-map") == 0) {
+            perf_map = true;
+        } else if (strcmp(argv[i], "--jitdump") == 0) {
+            jitdump = true;
+        } else if (strcmp(argv[i], "--gdb-jit") == 0) {
+            gdb_jit = true;
+        } else if (strcmp(argv[i], "--count") == 0 || strcmp(argv[i], "--count=loops") == 0) {
+            count_mode = true;
+        } else if (strcmp(argv[i], "--count=nodes") == 0) {
+            count_mode = true;
+            count_nodes = true;
+        } else if (strcmp(argv[i], "--count-json") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --count-json requires a filename\n");
+                return 1;
+            }
+            count_mode = true;
+            count_json = argv[i + 1];
+            i++;
         } else if (strcmp(argv[i], "--profile") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --profile requires a filename\n");
@@ -285,6 +152,19 @@ int main(int argc, char *argv[]) {
             profile_mode = true;
             profile_output = argv[i + 1];
             i++;
+        } else if (strcmp(argv[i], "--profile-hz") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --profile-hz requires a sample rate\n");
+                return 1;
+            }
+            char *endptr;
+            long hz = strtol(argv[i + 1], &endptr, 10);
+            if (*endptr != '\0' || hz <= 0 || hz > PROF_MAX_SAMPLE_RATE_HZ) {
+                fprintf(stderr, "Error: Invalid sample rate '%s' (1 to %d Hz)\n", argv[i + 1], PROF_MAX_SAMPLE_RATE_HZ);
+                return 1;
+            }
+            profile_hz = (int)hz;
+            i++;
         } else if (strcmp(argv[i], "--memory") == 0) {
             if (i + 1 >= argc) {
                 fprintf(stderr, "Error: --memory requires a size in bytes\n");
@@ -296,6 +176,7 @@ int main(int argc, char *argv[]) {
                 fprintf(stderr, "Error: Invalid memory size '%s'\n", argv[i + 1]);
                 return 1;
             }
+            memory_given = true;
             i++;
         } else if (strcmp(argv[i], "--memory-offset") == 0) {
             if (i + 1 >= argc) {
@@ -309,6 +190,118 @@ int main(int argc, char *argv[]) {
                 return 1;
             }
             i++;
+        } else if (strcmp(argv[i], "--eof") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --eof requires 0, -1 or unchanged\n");
+                return 1;
+            }
+            if (strcmp(argv[i + 1], "0") == 0) {
+                eof_mode = BF_EOF_ZERO;
+            } else if (strcmp(argv[i + 1], "-1") == 0) {
+                eof_mode = BF_EOF_MINUS_ONE;
+            } else if (strcmp(argv[i + 1], "unchanged") == 0) {
+                eof_mode = BF_EOF_UNCHANGED;
+            } else {
+                fprintf(stderr, "Error: Invalid EOF mode '%s' (expected 0, -1 or unchanged)\n", argv[i + 1]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--cache-dir") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --cache-dir requires a directory\n");
+                return 1;
+            }
+            cache_dir = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--peval-steps") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --peval-steps requires a step count\n");
+                return 1;
+            }
+            char *endptr;
+            peval_steps = strtol(argv[i + 1], &endptr, 10);
+            if (*endptr != '\0' || peval_steps < 0) {
+                fprintf(stderr, "Error: Invalid step count '%s'\n", argv[i + 1]);
+                return 1;
+            }
+            i++;
+        } else if (strcmp(argv[i], "--pgo-out") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --pgo-out requires a filename\n");
+                return 1;
+            }
+            pgo_output = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--pgo-in") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --pgo-in requires a filename\n");
+                return 1;
+            }
+            pgo_input = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--passes") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --passes requires a comma-separated pass list\n");
+                return 1;
+            }
+            pass_list = argv[i + 1];
+            i++;
+        } else if (strncmp(argv[i], "--passes=", 9) == 0) {
+            pass_list = argv[i] + 9;
+        } else if (strncmp(argv[i], "--tier=", 7) == 0) {
+            const char *name = argv[i] + 7;
+            if (strcmp(name, "jit") == 0) {
+                tier = BF_TIER_JIT;
+            } else if (strcmp(name, "interp") == 0) {
+                tier = BF_TIER_INTERP;
+            } else if (strcmp(name, "auto") == 0) {
+                tier = BF_TIER_AUTO;
+            } else {
+                fprintf(stderr, "Error: Invalid tier '%s' (expected interp, jit or auto)\n", name);
+                return 1;
+            }
+        } else if (strncmp(argv[i], "--tape=", 7) == 0) {
+            const char *kind = argv[i] + 7;
+            if (strcmp(kind, "fixed") == 0) {
+                grow_tape = false;
+            } else if (strcmp(kind, "grow") == 0) {
+                grow_tape = true;
+            } else {
+                fprintf(stderr, "Error: Invalid tape '%s' (expected fixed or grow)\n", kind);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--hugepages") == 0) {
+            hugepages = true;
+        } else if (strcmp(argv[i], "--lazy") == 0) {
+            lazy_mode = true;
+        } else if (strcmp(argv[i], "--code-arena") == 0) {
+            code_arena = true;
+        } else if (strcmp(argv[i], "--input") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --input requires a filename\n");
+                return 1;
+            }
+            input_file = argv[i + 1];
+            i++;
+        } else if (strcmp(argv[i], "--splice-output") == 0) {
+            splice_output = true;
+        } else if (strcmp(argv[i], "--batch") == 0) {
+            batch_mode = true;
+        } else if (strcmp(argv[i], "--batch-nul") == 0) {
+            batch_mode = true;
+            batch_delimiter = '\0';
+        } else if (strcmp(argv[i], "--jobs") == 0 || strcmp(argv[i], "-j") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "Error: --jobs requires a thread count\n");
+                return 1;
+            }
+            char *endptr;
+            batch_jobs = strtol(argv[i + 1], &endptr, 10);
+            if (*endptr != '\0' || batch_jobs < 1 || batch_jobs > BATCH_MAX_JOBS) {
+                fprintf(stderr, "Error: Invalid thread count '%s' (1 to %d)\n", argv[i + 1], BATCH_MAX_JOBS);
+                return 1;
+            }
+            i++;
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             show_help = true;
             break;
@@ -321,15 +314,46 @@ int main(int argc, char *argv[]) {
     if (show_help || arg_offset == -1) {
         FILE *stream = show_help ? stdout : stderr;
         fprintf(stream, "Usage: %s [options] <brainfuck_file>\n", argv[0]);
+        fprintf(stream, "       %s --batch [options] <brainfuck_file> [input_file...]\n", argv[0]);
         fprintf(stream, "\nOptions:\n");
         fprintf(stream, "  --help, -h        Show this help message\n");
         fprintf(stream, "  --debug           Enable debug mode (dump AST and compiled code)\n");
         fprintf(stream, "  --timing          Show execution phase timing\n");
+        fprintf(stream, "  --stats=json[:f]  Write pass, code size, tape and timing metrics as JSON to stderr or f\n");
         fprintf(stream, "  --no-optimize     Disable AST optimizations\n");
         fprintf(stream, "  --unsafe          Disable memory safety checks for performance\n");
         fprintf(stream, "  --profile file    Enable profiling (folded stack format)\n");
+        fprintf(stream, "  --profile-hz n    Profiler sample rate for --profile and --pgo-out (default: %d)\n", PROF_SAMPLE_RATE_HZ);
+        fprintf(stream, "  --count[=nodes]   Count loop entries and iterations (or every node) and print them at exit\n");
+        fprintf(stream, "  --count-json file Also write the counts as JSON (implies --count)\n");
+        fprintf(stream, "  --perf-map        Name JIT code for perf in /tmp/perf-<pid>.map\n");
+        fprintf(stream, "  --jitdump         Write a jitdump for 'perf inject --jit' to $JITDUMPDIR (default: /tmp)\n");
+        fprintf(stream, "  --gdb-jit         Register JIT code symbols with GDB's JIT interface\n");
         fprintf(stream, "  --memory size     Set memory size in bytes (default: %zu)\n", (size_t)BF_DEFAULT_MEMORY_SIZE);
         fprintf(stream, "  --memory-offset n Set initial pointer offset in bytes (default: 4096)\n");
+        fprintf(stream, "  --tape=kind       fixed: guarded --memory bytes (default), grow: reserve --memory bytes\n");
+        fprintf(stream, "                    (default: %zu GB) and commit them as they are touched (implies --unsafe)\n",
+                BF_TAPE_DEFAULT_RESERVE >> 30);
+        fprintf(stream, "  --hugepages       Back a growable tape with huge pages\n");
+        fprintf(stream, "  --eof mode        Value ',' stores at EOF: 0, -1 or unchanged (default: 0)\n");
+        fprintf(stream, "  --cache-dir dir   Reuse compiled code across runs (ignored with --debug)\n");
+        fprintf(stream, "  --passes list     Run only these optimization passes, in order (e.g. rle,offsets,mul)\n");
+        fprintf(stream, "  --peval-steps n   Run up to n steps of the input-independent prefix at compile time (default: %d, 0 disables)\n", BF_PEVAL_DEFAULT_STEPS);
+        fprintf(stream, "  --pgo-out file    Write per-node samples and loop trip counts of this run (ignores --cache-dir)\n");
+        fprintf(stream, "  --pgo-in file     Lay out code using a profile written by --pgo-out\n");
+        fprintf(stream, "  --tier=mode       jit: compile everything (default), interp: interpret only,\n");
+        fprintf(stream, "                    auto: interpret and compile loops after %d iterations\n", BF_INTERP_HOT_LOOP);
+        fprintf(stream, "  --lazy            Compile loops of %d or more nodes on first entry\n", BF_LAZY_MIN_NODES);
+        fprintf(stream, "  --code-arena      Append all code to one region with separate writable and executable views, no mprotect\n");
+        fprintf(stream, "  --input file      Read ',' input from file, mapped rather than copied when it is a regular file\n");
+        fprintf(stream, "  --splice-output   Hand output to a stdout pipe with vmsplice (Linux; the reader must not splice it on)\n");
+        fprintf(stream, "  --batch           Run once per input file, or per line of stdin without files\n");
+        fprintf(stream, "  --batch-nul       Like --batch, with NUL-separated records on stdin\n");
+        fprintf(stream, "  --jobs, -j n      Batch worker threads (default: one per CPU)\n");
+        fprintf(stream, "\nOptimization passes (default: all, in this order, to a fixed point):\n");
+        for (int p = 0; p < ast_pass_count; p++) {
+            fprintf(stream, "  %-17s %s\n", ast_passes[p].name, ast_passes[p].description);
+        }
         fprintf(stream, "\nExamples:\n");
         fprintf(stream, "  %s examples/hello.b\n", argv[0]);
         fprintf(stream, "  %s --debug examples/fizzbuzz.b\n", argv[0]);
@@ -337,9 +361,66 @@ int main(int argc, char *argv[]) {
         fprintf(stream, "  %s --profile profile.txt examples/mandelbrot.b\n", argv[0]);
         fprintf(stream, "  %s --memory 32768 examples/hello.b\n", argv[0]);
         fprintf(stream, "  %s --memory-offset 8192 examples/program.b\n", argv[0]);
+        fprintf(stream, "  %s --cache-dir ~/.cache/bf examples/mandelbrot.b\n", argv[0]);
+        fprintf(stream, "  %s --pgo-out train.pgo examples/mandelbrot.b\n", argv[0]);
+        fprintf(stream, "  %s --pgo-in train.pgo examples/mandelbrot.b\n", argv[0]);
+        fprintf(stream, "  %s --batch -j 8 examples/cat.b inputs/*.txt\n", argv[0]);
         return show_help ? 0 : 1;
     }
 
+    // Resolve the pass pipeline
+    const ast_pass_t *passes[MAX_PASSES];
+    int pass_count = 0;
+    char pass_names[1024] = "";
+    if (!optimize) {
+        pass_list = "";
+    }
+    if (!pass_list) {
+        for (int p = 0; p < ast_pass_count; p++) {
+            passes[pass_count++] = &ast_passes[p];
+        }
+    } else {
+        const char *name = pass_list;
+        while (*name) {
+            size_t len = strcspn(name, ",");
+            char pass_name[64];
+            if (len > 0) {
+                const ast_pass_t *pass = NULL;
+                if (len < sizeof(pass_name)) {
+                    memcpy(pass_name, name, len);
+                    pass_name[len] = '\0';
+                    pass = ast_find_pass(pass_name);
+                }
+                if (!pass) {
+                    fprintf(stderr, "Error: Unknown pass '%.*s' (see --help)\n", (int)len, name);
+                    return 1;
+                }
+                if (pass_count == MAX_PASSES) {
+                    fprintf(stderr, "Error: Too many passes (max %d)\n", MAX_PASSES);
+                    return 1;
+                }
+                passes[pass_count++] = pass;
+            }
+            name += len;
+            if (*name == ',') name++;
+        }
+    }
+    for (int p = 0; p < pass_count; p++) {
+        if (p > 0) strncat(pass_names, ",", sizeof(pass_names) - strlen(pass_names) - 1);
+        strncat(pass_names, passes[p]->name, sizeof(pass_names) - strlen(pass_names) - 1);
+    }
+
+    // A growable tape faults in what the program touches, and the fault is
+    // the bounds check, so the code runs unmasked over a large reservation
+    if (hugepages && !grow_tape) {
+        fprintf(stderr, "Error: --hugepages requires --tape=grow\n");
+        return 1;
+    }
+    if (grow_tape) {
+        if (!memory_given) memory_size = BF_TAPE_DEFAULT_RESERVE;
+        unsafe_mode = true;
+    }
+
     // Validate memory offset
     if (memory_offset >= memory_size) {
         fprintf(stderr, "Error: Memory offset (%zu) must be less than memory size (%zu)\n",
@@ -347,67 +428,268 @@ int main(int argc, char *argv[]) {
         return 1;
     }
 
+    // Training runs sample and count like --profile; a loaded profile only
+    // steers code generation
+    bf_pgo_t pgo;
+    bf_pgo_t *pgo_ptr = NULL;
+    if (pgo_input) {
+        if (bf_pgo_load(&pgo, pgo_input) != 0) {
+            fprintf(stderr, "Error: Could not read profile '%s'\n", pgo_input);
+            return 1;
+        }
+        pgo_ptr = &pgo;
+    }
+    bool sampling = profile_mode || pgo_output;
+    bool symbols_mode = perf_map || jitdump || gdb_jit;
+    bool counting = count_mode || pgo_output;
+
+    // Batch runs share one process-wide profiler and one set of counters,
+    // neither of which can tell the runs apart
+    if (batch_mode && (sampling || counting)) {
+        fprintf(stderr, "Error: --batch cannot be combined with --profile, --pgo-out or --count\n");
+        return 1;
+    }
+    // Batch runs take their input from files or stdin records and write
+    // each run's output in one piece
+    if (batch_mode && (input_file || splice_output)) {
+        fprintf(stderr, "Error: --batch cannot be combined with --input or --splice-output\n");
+        return 1;
+    }
+    // The interpreter has no code for samples, counters or symbols to refer to
+    if (tier != BF_TIER_JIT && (sampling || counting || symbols_mode || batch_mode)) {
+        fprintf(stderr, "Error: --tier=interp and --tier=auto cannot be combined with --profile, --pgo-out, --count, --batch or the symbol options\n");
+        return 1;
+    }
+    // Loops compiled later are missing from the PC map the profiler and
+    // symbol writers use, and from the counter layout
+    if (lazy_mode && (tier != BF_TIER_JIT || sampling || counting || symbols_mode)) {
+        fprintf(stderr, "Error: --lazy requires --tier=jit and cannot be combined with --profile, --pgo-out, --count or the symbol options\n");
+        return 1;
+    }
+    if (batch_mode && batch_jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        batch_jobs = cpus < 1 ? 1 : cpus > BATCH_MAX_JOBS ? BATCH_MAX_JOBS : cpus;
+    }
+
     // Start timing
-    double total_start = timing_mode ? get_time_ms() : 0.0;
+    bf_stats_t stats;
+    bf_stats_t *stats_ptr = NULL;
+    if (stats_mode) {
+        bf_stats_init(&stats);
+        stats_ptr = &stats;
+    }
+    bool timed = timing_mode || stats_mode;
+    double total_start = timed ? get_time_ms() : 0.0;
     double phase_start = total_start;
 
-    size_t program_size;
-    char *program = read_file(argv[arg_offset], &program_size);
+    bf_source_t source;
+    if (bf_source_open(&source, argv[arg_offset]) != 0) {
+        bf_error("Could not open file");
+    }
 
-    if (timing_mode) {
-        double phase_end = get_time_ms();
-        print_phase_time("File I/O", phase_start, phase_end);
-        phase_start = phase_end;
+    if (timed) {
+        end_phase("File I/O", &phase_start, timing_mode, stats_ptr);
     }
 
-    bf_func compiled_program;
+    bf_func compiled_program = NULL;
     ast_node_t *ast = NULL;
+    void *code_ptr = NULL;
+    size_t code_size = 0;
+    // Adjust memory size for JIT compilation to account for offset
+    size_t effective_memory_size = tape_size_pow2(memory_size - memory_offset);
 
-    ast = parse_bf_program(program);
+    // The code cache also stores the debug map, so it is always collected
+    // when caching; --debug dumps compiler internals and counted code is
+    // tied to the tree that assigned its counters, so both bypass the cache;
+    // lazy stubs point into this process, and --stats measures the compile
+    bool use_cache = cache_dir && !debug_mode && !counting && !lazy_mode && !stats_mode && tier == BF_TIER_JIT;
+    bf_cache_flags_t cache_flags;
+    uint64_t cache_key = 0;
 
-    if (timing_mode) {
-        double phase_end = get_time_ms();
-        print_phase_time("Parsing", phase_start, phase_end);
-        phase_start = phase_end;
-    }
+    bf_counters_t counters;
+    bf_counters_init(&counters, count_nodes);
 
-    if (optimize) {
-        ast = ast_rewrite_sequences(ast);
-        ast = ast_optimize(ast);
-        ast = ast_rewrite_sequences(ast);
-        ast = ast_optimize(ast);
+    bf_peval_t prelude;
+    bf_peval_t *prelude_ptr = NULL;
+    memset(&prelude, 0, sizeof(prelude));
 
-        if (timing_mode) {
-            double phase_end = get_time_ms();
-            print_phase_time("AST Optimization", phase_start, phase_end);
-            phase_start = phase_end;
-        }
-    }
-
-    if (debug_mode) {
-        fprintf(stderr, "%s AST dump:\n", optimize ? "Optimized" : "Unoptimized");
-        ast_print(ast, 0);
-    }
+    ast_pass_stats_t pass_stats[MAX_PASSES];
+    memset(pass_stats, 0, sizeof(pass_stats));
 
     bf_debug_info_t debug_info;
     bf_debug_info_t *debug_ptr = NULL;
-    if (profile_mode) {
+    // --stats sizes each node's code by its debug label
+    if (sampling || use_cache || symbols_mode || stats_mode) {
         debug_ptr = &debug_info;
         if (bf_debug_init(debug_ptr, NULL, 0) != 0) {
             bf_error("Failed to initialize debug info");
         }
     }
 
-    void *code_ptr = NULL;
-    size_t code_size = 0;
-    // Adjust memory size for JIT compilation to account for offset
-    size_t effective_memory_size = memory_size - memory_offset;
-    compiled_program = compile_bf_ast(ast, debug_mode, unsafe_mode, &code_ptr, &code_size, debug_ptr, effective_memory_size);
+    if (use_cache) {
+        cache_flags.memory_mask = effective_memory_size - 1;
+        cache_flags.unsafe_mode = unsafe_mode;
+        cache_flags.eof_mode = eof_mode;
+        cache_flags.optimize = pass_count > 0;
+        cache_flags.passes = pass_names;
+        cache_flags.peval_steps = pass_count > 0 ? (uint64_t)peval_steps : 0;
+        cache_flags.pgo_hash = pgo_ptr ? pgo_ptr->hash : 0;
+        cache_flags.cpu_features = bf_codegen_features();
+        cache_flags.codegen_id = bf_codegen_id();
+        cache_key = bf_cache_key(source.data, source.size, &cache_flags);
 
-    if (timing_mode) {
-        double phase_end = get_time_ms();
-        print_phase_time("JIT Compilation", phase_start, phase_end);
-        phase_start = phase_end;
+        code_ptr = bf_cache_load(cache_dir, cache_key, &cache_flags, &code_size, debug_ptr);
+        compiled_program = (bf_func)code_ptr;
+
+        if (timed) {
+            end_phase(compiled_program ? "Code Cache (hit)" : "Code Cache (miss)", &phase_start, timing_mode, stats_ptr);
+        }
+    }
+
+    // The profiler attributes samples to AST nodes and the symbol writers
+    // name code after loops, so they need the tree even when the code
+    // itself came from the cache
+    if (!compiled_program || sampling || symbols_mode) {
+        // Folding runs while scanning saves building a node per character
+        // when the rle pass would merge them anyway
+        bool fold_runs = false;
+        for (int p = 0; p < pass_count; p++) {
+            if (strcmp(passes[p]->name, "rle") == 0) fold_runs = true;
+        }
+        char parse_error[256];
+        if (bf_scan(source.data, source.size, fold_runs, &ast, parse_error, sizeof(parse_error)) != 0) {
+            fprintf(stderr, "%s\n", parse_error);
+            bf_error("Parser error");
+        }
+
+        if (timed) {
+            end_phase("Parsing", &phase_start, timing_mode, stats_ptr);
+        }
+        if (stats_mode) {
+            ast_count_types(ast, stats.parsed_nodes);
+        }
+
+        if (pass_count > 0) {
+            ast_set_tape_wrap(unsafe_mode ? 0 : effective_memory_size);
+            ast = ast_run_passes(ast, passes, pass_count, timed ? pass_stats : NULL);
+            ast = ast_arena_compact(ast);
+
+            if (timed) {
+                end_phase("AST Optimization", &phase_start, timing_mode, stats_ptr);
+            }
+            if (timing_mode) {
+                for (int p = 0; p < pass_count; p++) {
+                    char label[32];
+                    snprintf(label, sizeof(label), "  %s", passes[p]->name);
+                    print_phase_time(label, 0.0, pass_stats[p].ms);
+                }
+            }
+            if (stats_mode) {
+                stats.optimized = true;
+                stats.passes = passes;
+                stats.pass_stats = pass_stats;
+                stats.pass_count = pass_count;
+            }
+        }
+
+        // Partial evaluation is part of optimizing; the cache key covers it
+        if (!compiled_program && pass_count > 0 && peval_steps > 0) {
+            // A growable tape is only simulated near the initial cell; the
+            // prefix stops where it would leave that window
+            size_t peval_size = grow_tape ? BF_DEFAULT_MEMORY_SIZE : unsafe_mode ? memory_size : effective_memory_size;
+            size_t peval_origin = grow_tape ? BF_DEFAULT_MEMORY_OFFSET : unsafe_mode ? memory_offset : 0;
+            bf_peval_run(&prelude, ast, peval_steps, peval_size, peval_origin, !unsafe_mode);
+            if (prelude.residual != ast) {
+                ast = prelude.residual ? ast_arena_compact(prelude.residual) : NULL;
+                prelude_ptr = &prelude;
+            }
+
+            if (timed) {
+                end_phase("Partial Evaluation", &phase_start, timing_mode, stats_ptr);
+            }
+            if (debug_mode) {
+                fprintf(stderr, "Partial evaluation: %ld steps, %zu output bytes, %zu-byte tape image, %s\n",
+                        prelude.steps, prelude.output_size, prelude.image_size,
+                        prelude.complete ? "complete" : prelude_ptr ? "residual program follows" : "nothing folded");
+            }
+        }
+
+        if (pgo_ptr && ast) {
+            bf_pgo_annotate(pgo_ptr, ast);
+        }
+
+        if (debug_mode) {
+            fprintf(stderr, "%s AST dump:\n", pass_count > 0 ? "Optimized" : "Unoptimized");
+            ast_print(ast, 0);
+        }
+        if (stats_mode) {
+            bf_stats_tree(&stats, ast);
+        }
+    }
+
+    // Lazy loops and tier-up fragments are compiled into the same arena as
+    // the program, if there is one; --tier=interp maps no code at all
+    bf_code_arena_t *arena = NULL;
+    if (code_arena && tier != BF_TIER_INTERP && !compiled_program) {
+        arena = bf_code_arena_create(BF_CODE_ARENA_SIZE);
+        if (!arena) {
+            perror("Warning: Could not map a code arena");
+        }
+    }
+
+    bf_interp_t *interp = NULL;
+    bf_lazy_t *lazy = NULL;
+    if (tier != BF_TIER_JIT) {
+        // Fragments compiled from hot loops share the tape layout and EOF
+        // convention; the prelude is written by the interpreter
+        bf_codegen_options_t codegen = {
+            .unsafe_mode = unsafe_mode,
+            .eof_mode = eof_mode,
+            .memory_size = effective_memory_size,
+            .debug_mode = debug_mode,
+            .prelude = prelude_ptr,
+            .arena = arena,
+        };
+        interp = bf_interp_create(ast, &codegen, tier == BF_TIER_AUTO ? BF_INTERP_HOT_LOOP : 0);
+
+        if (timed) {
+            end_phase("Interpreter Setup", &phase_start, timing_mode, stats_ptr);
+        }
+    } else if (!compiled_program) {
+        bf_codegen_options_t codegen = {
+            .unsafe_mode = unsafe_mode,
+            .eof_mode = eof_mode,
+            .memory_size = effective_memory_size,
+            .debug_mode = debug_mode,
+            .prelude = prelude_ptr,
+            .pgo = pgo_ptr,
+            .counters = counting ? &counters : NULL,
+            .debug_info = debug_ptr,
+            .arena = arena,
+        };
+        if (lazy_mode) {
+            lazy = bf_lazy_create(&codegen);
+            codegen.lazy = lazy;
+        }
+        compiled_program = bf_codegen_compile(ast, &codegen, &code_ptr, &code_size);
+        if (!compiled_program) {
+            bf_error("JIT compilation failed");
+        }
+
+        if (timed) {
+            end_phase("JIT Compilation", &phase_start, timing_mode, stats_ptr);
+        }
+        if (timing_mode) {
+            fprintf(stderr, "%-20s: %8zu bytes\n", "Code Size", code_size);
+        }
+        if (stats_mode) {
+            bf_stats_code(&stats, debug_ptr, code_size);
+        }
+
+        if (use_cache && bf_cache_store(cache_dir, cache_key, &cache_flags, code_ptr, code_size, debug_ptr) != 0) {
+            fprintf(stderr, "Warning: Could not write code cache in '%s'\n", cache_dir);
+        }
+        bf_peval_free(&prelude);
     }
 
     if (debug_ptr) {
@@ -415,44 +697,178 @@ int main(int argc, char *argv[]) {
         debug_ptr->code_size = code_size;
     }
 
+    bf_symbols_t symbols;
+    if (symbols_mode) {
+        if (bf_debug_resolve_nodes(debug_ptr, ast) != 0 || bf_symbols_build(&symbols, debug_ptr, ast) != 0) {
+            bf_error("Failed to build JIT symbols");
+        }
+        if (perf_map && bf_perf_write_map(&symbols) != 0) {
+            fprintf(stderr, "Warning: Could not write perf map\n");
+        }
+        if (jitdump && bf_perf_write_jitdump(&symbols) != 0) {
+            fprintf(stderr, "Warning: Could not write jitdump\n");
+        }
+        if (gdb_jit && bf_gdb_register(&symbols) != 0) {
+            fprintf(stderr, "Warning: Could not register JIT code with GDB\n");
+        }
+    }
+
     bf_profiler_t profiler;
-    if (profile_mode) {
-        if (bf_prof_init(&profiler, code_ptr, code_size, debug_ptr, ast) != 0) {
+    if (sampling) {
+        if (bf_prof_init(&profiler, code_ptr, code_size, debug_ptr, ast, profile_hz) != 0) {
             bf_error("Failed to initialize profiler");
         }
-        bf_prof_start(&profiler);
+        if (bf_prof_start(&profiler) != 0) {
+            bf_error("Failed to start profiler");
+        }
     }
 
-    char *memory = allocate_guarded_memory(memory_size);
-    if (!memory) {
-        bf_error("Memory allocation failed");
-    }
+    char *memory = NULL;
+    bf_tape_t tape = { 0 };
+    int status = 0;
+    if (batch_mode) {
+        // Workers allocate their own tapes
+        bf_batch_t batch = {
+            .code = compiled_program,
+            .eof_mode = eof_mode,
+            .memory_size = memory_size,
+            .memory_offset = memory_offset,
+            .grow_tape = grow_tape,
+            .hugepages = hugepages,
+            .jobs = (int)batch_jobs,
+        };
+        int ret = batch_count > 0
+            ? bf_batch_run_files(&batch, batch_inputs, batch_count, STDOUT_FILENO)
+            : bf_batch_run_records(&batch, STDIN_FILENO, batch_delimiter, STDOUT_FILENO);
+        status = ret == 0 ? 0 : 1;
+
+        if (timed) {
+            end_phase("Program Execution", &phase_start, timing_mode, stats_ptr);
+        }
+    } else {
+        char *tape_start;
+        if (grow_tape) {
+            if (bf_tape_reserve(&tape, memory_size, memory_offset, hugepages) != 0) {
+                bf_error("Tape reservation failed");
+            }
+            tape_start = tape.start;
+        } else {
+            memory = allocate_guarded_memory(memory_size);
+            if (!memory) {
+                bf_error("Memory allocation failed");
+            }
+            tape_start = memory + memory_offset;
+        }
 
-    if (timing_mode) {
-        double phase_end = get_time_ms();
-        print_phase_time("Memory Allocation", phase_start, phase_end);
-        phase_start = phase_end;
-    }
+        if (timed) {
+            end_phase("Memory Allocation", &phase_start, timing_mode, stats_ptr);
+        }
 
-    compiled_program(memory + memory_offset);
+        // Counted code finds its counters right after the I/O state
+        bf_io_t *io = calloc(1, sizeof(bf_io_t) + (size_t)counters.count * sizeof(uint64_t));
+        if (!io) {
+            bf_error("Memory allocation failed");
+        }
+        int input_fd = STDIN_FILENO;
+        if (input_file) {
+            input_fd = open(input_file, O_RDONLY);
+            if (input_fd < 0) {
+                fprintf(stderr, "Error: Could not open input file '%s'\n", input_file);
+                return 1;
+            }
+        }
+        bf_io_init(io, input_fd, STDOUT_FILENO, eof_mode);
+        io->debug_log = bf_codegen_debug_log;
+        // Both fall back to plain reads and writes where they do not apply
+        if (input_file) {
+            bf_io_map_input(io);
+        }
+        if (splice_output) {
+            bf_io_pipe_output(io);
+        }
 
-    if (timing_mode) {
-        double phase_end = get_time_ms();
-        print_phase_time("Program Execution", phase_start, phase_end);
-        phase_start = phase_end;
+        if (interp) {
+            bf_interp_run(interp, tape_start, io);
+        } else {
+            compiled_program(tape_start, io);
+        }
+        bf_io_flush(io);
+
+        if (timed) {
+            end_phase("Program Execution", &phase_start, timing_mode, stats_ptr);
+        }
+        if (stats_mode) {
+            if (grow_tape) {
+                bf_stats_tape(&stats, tape.region, tape.size, tape.start);
+                stats.tape_committed = bf_tape_committed(&tape);
+            } else {
+                bf_stats_tape(&stats, memory, memory_size, tape_start);
+            }
+            stats.bytes_read = bf_io_bytes_read(io);
+            stats.bytes_written = io->bytes_written;
+        }
+        if (timing_mode) {
+            if (tier == BF_TIER_AUTO) {
+                size_t tier_size;
+                int tier_loops = bf_interp_compiled_loops(interp, &tier_size);
+                fprintf(stderr, "%-20s: %8d loops, %zu bytes\n", "Tier-up", tier_loops, tier_size);
+            }
+            if (grow_tape) {
+                fprintf(stderr, "%-20s: %8zu KB\n", "Tape Committed", bf_tape_committed(&tape) >> 10);
+            }
+            if (lazy) {
+                int lazy_stubs;
+                size_t lazy_size;
+                int lazy_loops = bf_lazy_compiled_loops(lazy, &lazy_stubs, &lazy_size);
+                fprintf(stderr, "%-20s: %8d of %d loops, %zu bytes\n", "Lazy Compilation", lazy_loops, lazy_stubs, lazy_size);
+            }
+            if (arena) {
+                fprintf(stderr, "%-20s: %8zu KB\n", "Code Arena", bf_code_arena_used(arena) >> 10);
+            }
+        }
+
+        if (sampling) {
+            bf_prof_stop(&profiler);
+        }
+
+        if (counting) {
+            bf_counters_apply(&counters, (const uint64_t *)(io + 1));
+        }
+        bf_io_release(io);
+        free(io);
+        if (input_file) close(input_fd);
+    }
+
+    if (count_mode) {
+        fprintf(stderr, "Execution counts:\n");
+        ast_print_counts(ast, 0);
+        if (count_json) {
+            FILE *json_out = fopen(count_json, "w");
+            if (!json_out || bf_count_write_json(ast, count_nodes, json_out) != 0) {
+                fprintf(stderr, "Warning: Could not write counts to '%s'\n", count_json);
+            }
+            if (json_out) fclose(json_out);
+        }
     }
 
-    if (profile_mode) {
-        bf_prof_stop(&profiler);
+    if (pgo_output) {
+        if (bf_pgo_write(ast, pgo_output) != 0) {
+            fprintf(stderr, "Warning: Could not write profile '%s'\n", pgo_output);
+        } else {
+            fprintf(stderr, "PGO profile written to: %s\n", pgo_output);
+        }
+    }
 
+    if (profile_mode) {
         FILE *prof_out = fopen(profile_output, "w");
         if (!prof_out) {
             fprintf(stderr, "Error: Could not open profile output file '%s'\n", profile_output);
             bf_prof_cleanup(&profiler);
             if (debug_ptr) bf_debug_cleanup(debug_ptr);
-            free(program);
+            bf_source_close(&source);
             free_guarded_memory(memory, memory_size);
-            if (ast) ast_free(ast);
+            ast_arena_reset();
+            if (pgo_ptr) bf_pgo_free(pgo_ptr);
             return 1;
         }
 
@@ -464,21 +880,42 @@ int main(int argc, char *argv[]) {
         bf_prof_cleanup(&profiler);
     }
 
+    if (symbols_mode) {
+        if (gdb_jit) bf_gdb_unregister();
+        bf_symbols_free(&symbols);
+    }
+
     if (debug_ptr) {
         bf_debug_cleanup(debug_ptr);
     }
 
-    free(program);
+    bf_source_close(&source);
     free_guarded_memory(memory, memory_size);
+    bf_tape_release(&tape);
     if (timing_mode) {
         double total_end = get_time_ms();
         fprintf(stderr, "%-20s  --------\n", "");
         print_phase_time("Total Time", total_start, total_end);
     }
+    if (stats_mode) {
+        stats.total_ms = get_time_ms() - total_start;
+        FILE *stats_out = stats_file ? fopen(stats_file, "w") : stderr;
+        if (!stats_out || bf_stats_write_json(&stats, stats_out) != 0) {
+            fprintf(stderr, "Warning: Could not write stats to '%s'\n", stats_file ? stats_file : "stderr");
+        }
+        if (stats_out && stats_out != stderr) fclose(stats_out);
+    }
 
-    if (ast) {
-        ast_free(ast);
+    ast_arena_reset();
+    if (pgo_ptr) {
+        bf_pgo_free(pgo_ptr);
     }
+    bf_counters_free(&counters);
+    bf_interp_free(interp);
+    bf_lazy_free(lazy);
+    bf_code_arena_free(arena);
+    bf_peval_free(&prelude);
+    free(batch_inputs);
 
-    return 0;
+    return status;
 }
@@ -1,13 +1,53 @@
 #include "bf_ast.h"
 #include <string.h>
 #include <stdbool.h>
-
-ast_node_t* ast_create_node(ast_node_type_t type) {
-    ast_node_t *node = calloc(1, sizeof(ast_node_t));
-    if (!node) {
+#include <time.h>
+
+// Node arena: nodes are bump-allocated from chunks and never freed one at
+// a time. Passes simply unlink nodes they drop; ast_arena_compact() copies
+// one live tree into a contiguous array and ast_arena_reset() releases
+// everything. The arena is per thread, so threads can parse and compile
+// concurrently, but each thread holds one tree at a time: compacting or
+// resetting invalidates every other node the thread allocated.
+#define AST_ARENA_CHUNK_NODES 4096
+
+typedef struct ast_chunk {
+    struct ast_chunk *prev;     // Previously filled chunk
+    size_t used;                // Nodes handed out from this chunk
+    size_t capacity;            // Nodes this chunk can hold
+    ast_node_t nodes[];
+} ast_chunk_t;
+
+static __thread ast_chunk_t *ast_arena = NULL;
+
+static ast_chunk_t *ast_arena_grow(size_t capacity) {
+    ast_chunk_t *chunk = malloc(sizeof(ast_chunk_t) + capacity * sizeof(ast_node_t));
+    if (!chunk) {
         fprintf(stderr, "Memory allocation failed\n");
         exit(1);
     }
+    chunk->prev = ast_arena;
+    chunk->used = 0;
+    chunk->capacity = capacity;
+    ast_arena = chunk;
+    return chunk;
+}
+
+static void ast_arena_release(ast_chunk_t *chunk) {
+    while (chunk) {
+        ast_chunk_t *prev = chunk->prev;
+        free(chunk);
+        chunk = prev;
+    }
+}
+
+ast_node_t* ast_create_node(ast_node_type_t type) {
+    ast_chunk_t *chunk = ast_arena;
+    if (!chunk || chunk->used == chunk->capacity) {
+        chunk = ast_arena_grow(AST_ARENA_CHUNK_NODES);
+    }
+    ast_node_t *node = &chunk->nodes[chunk->used++];
+    memset(node, 0, sizeof(*node));
     node->type = type;
     return node;
 }
@@ -77,14 +117,63 @@ ast_node_t* ast_create_mul(int multiplier, int src_offset, int dst_offset) {
     return node;
 }
 
-void ast_free(ast_node_t *node) {
-    if (!node) return;
+ast_node_t* ast_create_scan(int stride) {
+    ast_node_t *node = ast_create_node(AST_SCAN);
+    node->data.basic.count = stride;
+    return node;
+}
+
+ast_node_t* ast_create_mul2(int multiplier, int src_offset, int src2_offset, int dst_offset) {
+    ast_node_t *node = ast_create_node(AST_MUL2);
+    node->data.mul.multiplier = multiplier;
+    node->data.mul.src_offset = src_offset;
+    node->data.mul.src2_offset = src2_offset;
+    node->data.mul.dst_offset = dst_offset;
+    return node;
+}
+
+void ast_arena_reset(void) {
+    ast_arena_release(ast_arena);
+    ast_arena = NULL;
+}
 
-    if (node->type == AST_LOOP) {
-        ast_free(node->data.loop.body);
+// Copy a sibling list into nodes[used...], linking it as it goes
+static size_t ast_copy_list(ast_node_t *nodes, size_t used, ast_node_t *src) {
+    for (; src; src = src->next) {
+        nodes[used] = *src;
+        nodes[used].next = src->next ? &nodes[used + 1] : NULL;
+        used++;
     }
-    ast_free(node->next);
-    free(node);
+    return used;
+}
+
+// Copy the live tree into a single array and drop everything else in the
+// arena. Each sibling list becomes a contiguous run, so a loop body is an
+// index range [body, body + length) and sequence walks are linear scans.
+// Bodies are copied breadth-first using the array itself as the work
+// queue, without recursion.
+ast_node_t* ast_arena_compact(ast_node_t *node) {
+    if (!node) return NULL;
+
+    size_t total = (size_t)ast_count_nodes(node);
+    ast_chunk_t *old = ast_arena;
+    ast_arena = NULL;
+
+    ast_chunk_t *chunk = ast_arena_grow(total);
+    ast_node_t *nodes = chunk->nodes;
+    size_t used = ast_copy_list(nodes, 0, node);
+
+    for (size_t i = 0; i < used; i++) {
+        if (ast_has_body(&nodes[i])) {
+            ast_node_t *body = nodes[i].data.loop.body;
+            nodes[i].data.loop.body = &nodes[used];
+            used = ast_copy_list(nodes, used, body);
+        }
+    }
+    chunk->used = used;
+
+    ast_arena_release(old);
+    return nodes;
 }
 
 static const char* ast_type_name(ast_node_type_t type) {
@@ -94,18 +183,17 @@ static const char* ast_type_name(ast_node_type_t type) {
         case AST_OUTPUT: return "OUTPUT";
         case AST_INPUT: return "INPUT";
         case AST_LOOP: return "LOOP";
+        case AST_IF: return "IF";
         case AST_DEBUG_LOG: return "DEBUG_LOG";
         case AST_SET_CONST: return "SET_CONST";
         case AST_MUL: return "MUL";
+        case AST_SCAN: return "SCAN";
+        case AST_MUL2: return "MUL2";
         default: return "UNKNOWN";
     }
 }
 
-void ast_print(ast_node_t *node, int indent) {
-    if (!node) return;
-
-    for (int i = 0; i < indent; i++) fprintf(stderr, "  ");
-
+static void ast_print_details(ast_node_t *node) {
     fprintf(stderr, "%s", ast_type_name(node->type));
     switch (node->type) {
         case AST_MOVE_PTR:
@@ -131,316 +219,1123 @@ void ast_print(ast_node_t *node, int indent) {
                    node->data.mul.src_offset,
                    node->data.mul.dst_offset);
             break;
+        case AST_MUL2:
+            fprintf(stderr, " (%d*[%d]*[%d] -> [%d])",
+                   node->data.mul.multiplier,
+                   node->data.mul.src_offset,
+                   node->data.mul.src2_offset,
+                   node->data.mul.dst_offset);
+            break;
         case AST_INPUT:
         case AST_OUTPUT:
             if (node->data.basic.offset != 0) {
                 fprintf(stderr, " (offset: %d)", node->data.basic.offset);
             }
             break;
+        case AST_SCAN:
+            fprintf(stderr, " (stride: %d)", node->data.basic.count);
+            break;
         default:
             break;
     }
     if (node->line > 0 || node->column > 0) {
         fprintf(stderr, " \033[90m@%d:%d\033[0m", node->line, node->column);
     }
-    fprintf(stderr, "\n");
+}
 
-    if (node->type == AST_LOOP && node->data.loop.body) {
-        ast_print(node->data.loop.body, indent + 1);
+void ast_print(ast_node_t *node, int indent) {
+    // Walk siblings iteratively; only loop bodies recurse
+    for (; node; node = node->next) {
+        for (int i = 0; i < indent; i++) fprintf(stderr, "  ");
+        ast_print_details(node);
+        fprintf(stderr, "\n");
+
+        if (ast_has_body(node)) {
+            ast_print(node->data.loop.body, indent + 1);
+        }
     }
+}
+
+// ast_print with the --count results: entries, iterations and average
+// trip count for loops, runs for other nodes when they were counted
+void ast_print_counts(ast_node_t *node, int indent) {
+    for (; node; node = node->next) {
+        for (int i = 0; i < indent; i++) fprintf(stderr, "  ");
+        ast_print_details(node);
+        if (node->type == AST_LOOP || node->type == AST_IF) {
+            fprintf(stderr, "  [entries: %llu, iterations: %llu",
+                    (unsigned long long)node->profile_entries, (unsigned long long)node->profile_iterations);
+            if (node->profile_entries > 0) {
+                fprintf(stderr, ", avg trip: %.1f", (double)node->profile_iterations / (double)node->profile_entries);
+            }
+            fprintf(stderr, "]");
+        } else if (node->profile_runs > 0) {
+            fprintf(stderr, "  [runs: %llu]", (unsigned long long)node->profile_runs);
+        }
+        fprintf(stderr, "\n");
 
-    if (node->next) {
-        ast_print(node->next, indent);
+        if (ast_has_body(node)) {
+            ast_print_counts(node->data.loop.body, indent + 1);
+        }
     }
 }
 
-static bool is_multiplication_loop(ast_node_t *loop) {
-    if (loop->type != AST_LOOP || !loop->data.loop.body) return false;
+static __thread size_t ast_tape_wrap = 0;
 
-    ast_node_t *body = loop->data.loop.body;
-    bool has_counter_decrement = false;
+void ast_set_tape_wrap(size_t cells) {
+    ast_tape_wrap = cells;
+}
 
-    for (ast_node_t *op = body; op; op = op->next) {
-        if (op->type == AST_ADD_VAL) {
-            if (op->data.basic.offset == 0) {
-                if (op->data.basic.count == -1 && !has_counter_decrement) {
-                    has_counter_decrement = true;
-                } else {
-                    return false; // Multiple or wrong counter modifications
-                }
-            }
-        } else if (op->type == AST_MOVE_PTR) {
+// The offset in [-wrap/2, wrap/2) that names the same cell
+static long wrap_offset(long offset) {
+    if (ast_tape_wrap == 0) return offset;
+    long size = (long)ast_tape_wrap;
+    long cell = (offset % size + size) % size;
+    return cell >= size - size / 2 ? cell - size : cell;
+}
+
+// Nodes that move the pointer by a data-dependent amount end a basic block
+static bool ends_basic_block(ast_node_t *node) {
+    return node->type == AST_LOOP || node->type == AST_IF || node->type == AST_SCAN;
+}
+
+// Optimization passes. Each one rewrites a single sibling list in one
+// linear walk and never descends into loop bodies; ast_run_passes()
+// applies it to every list, innermost first, so loops are rewritten after
+// their bodies. A pass returns the number of rewrites it made, 0 if it
+// changed nothing.
+
+// Run-length encoding: merge consecutive MOVE_PTR, and ADD_VAL at the same
+// offset; drop moves and adds that cancel out
+static int pass_rle(ast_node_t **list) {
+    int changed = 0;
+    ast_node_t **link = list;
+
+    while (*link) {
+        ast_node_t *node = *link;
+        ast_node_t *next = node->next;
+
+        if ((node->type == AST_MOVE_PTR && node->data.basic.count == 0) ||
+            (node->type == AST_ADD_VAL && (node->data.basic.count & 0xFF) == 0)) {
+            *link = next;
+            changed++;
+            continue;
+        }
+        if (next && next->type == node->type && node->type == AST_MOVE_PTR) {
+            node->data.basic.count = (int)wrap_offset((long)node->data.basic.count + next->data.basic.count);
+            node->next = next->next;
+            changed++;
+            continue;
+        }
+        if (next && next->type == node->type &&
+            node->type == AST_ADD_VAL && node->data.basic.offset == next->data.basic.offset) {
+            node->data.basic.count += next->data.basic.count;
+            node->next = next->next;
+            changed++;
             continue;
-        } else {
-            return false;
         }
+        link = &node->next;
     }
 
-    return has_counter_decrement;
+    return changed;
 }
 
-ast_node_t* ast_optimize(ast_node_t *node) {
-    if (!node) return NULL;
+// Sequence rewriting: fold pointer movements inside a basic block into the
+// offsets of the nodes after them, leaving one MOVE_PTR at the block end
+static int pass_offsets(ast_node_t **list) {
+    int changed = 0;
+    ast_node_t **link = list;
+
+    while (*link) {
+        ast_node_t *first_move = NULL;  // Reused for the final move (keeps its location)
+        int moves = 0;
+        int delta = 0;
+        bool move_last = false;
+
+        while (*link && !ends_basic_block(*link)) {
+            ast_node_t *node = *link;
+
+            switch (node->type) {
+                case AST_MOVE_PTR:
+                    delta = (int)wrap_offset((long)delta + node->data.basic.count);
+                    moves++;
+                    if (!first_move) first_move = node;
+                    move_last = true;
+                    *link = node->next;
+                    continue;
+                case AST_ADD_VAL:
+                case AST_SET_CONST:
+                case AST_INPUT:
+                case AST_OUTPUT:
+                    node->data.basic.offset = (int)wrap_offset((long)node->data.basic.offset + delta);
+                    break;
+                case AST_MUL2:
+                    node->data.mul.src2_offset = (int)wrap_offset((long)node->data.mul.src2_offset + delta);
+                    // fall through
+                case AST_MUL:
+                    node->data.mul.src_offset = (int)wrap_offset((long)node->data.mul.src_offset + delta);
+                    node->data.mul.dst_offset = (int)wrap_offset((long)node->data.mul.dst_offset + delta);
+                    break;
+                default:
+                    break;
+            }
+            move_last = false;
+            link = &node->next;
+        }
+
+        if (moves > 0) {
+            // Already in normal form: exactly one nonzero move, at the end
+            if (moves > 1 || !move_last || delta == 0) changed++;
+
+            if (delta != 0) {
+                first_move->data.basic.count = delta;
+                first_move->next = *link;
+                *link = first_move;
+                link = &first_move->next;
+            }
+        }
+
+        // Step over the loop or scan that ended the block
+        if (*link) link = &(*link)->next;
+    }
+
+    return changed;
+}
 
-    // Run-length encoding: combine consecutive ADD_VAL or MOVE_PTR operations FIRST
-    if (node->next && node->type == node->next->type) {
-        if (node->type == AST_MOVE_PTR) {
-            node->data.basic.count += node->next->data.basic.count;
-            ast_node_t *old_next = node->next;
-            node->next = node->next->next;
-            free(old_next);
+// Clear loops: [-] and [+] (any odd step) become SET_CONST(0)
+static int pass_clear(ast_node_t **list) {
+    int changed = 0;
+
+    for (ast_node_t *node = *list; node; node = node->next) {
+        ast_node_t *body = node->type == AST_LOOP ? node->data.loop.body : NULL;
+        if (body && !body->next && body->type == AST_ADD_VAL &&
+            body->data.basic.offset == 0 && (body->data.basic.count & 1)) {
+            // Location is already preserved in node
+            node->type = AST_SET_CONST;
+            node->data.basic.count = 0;
+            node->data.basic.offset = 0;
+            changed++;
+        }
+    }
 
-            return ast_optimize(node);
-        } else if (node->type == AST_ADD_VAL &&
-                   node->data.basic.offset == node->next->data.basic.offset) {
-            node->data.basic.count += node->next->data.basic.count;
-            ast_node_t *old_next = node->next;
-            node->next = node->next->next;
-            free(old_next);
+    return changed;
+}
 
-            return ast_optimize(node);
+// Scan loops: [>], [<], [>>>>] become SCAN
+static int pass_scan(ast_node_t **list) {
+    int changed = 0;
+
+    for (ast_node_t *node = *list; node; node = node->next) {
+        ast_node_t *body = node->type == AST_LOOP ? node->data.loop.body : NULL;
+        if (body && !body->next && body->type == AST_MOVE_PTR && body->data.basic.count != 0) {
+            int stride = body->data.basic.count;
+            node->type = AST_SCAN;
+            node->data.basic.count = stride;
+            node->data.basic.offset = 0;
+            changed++;
         }
     }
 
-    // Now optimize children recursively (after copy detection)
-    if (node->type == AST_LOOP && node->data.loop.body) {
-        node->data.loop.body = ast_optimize(node->data.loop.body);
+    return changed;
+}
+
+// Affine loop elimination. The body of a balanced, I/O-free loop (only
+// ADD_VAL, SET_CONST, MUL and MOVE_PTR, inner loops already rewritten) is
+// executed symbolically: every touched cell's value after one iteration is
+// an affine form over the cell values at the start of the iteration. If
+// the counter (offset 0) steps by an odd constant s, the loop runs exactly
+// n = counter * inverse(-s) times (mod 256) and the whole loop has a
+// closed form:
+//   accumulators  x += c + sum a_j * y_j      ->  MUL(counter) and MUL2(counter, y_j)
+//   reset cells   x = c + sum a_j * y_j       ->  SET_CONST + MUL, only if n > 0
+// where the y_j are cells the body never writes. When a cell reads a reset
+// cell, one iteration is peeled first so the reset cell holds its steady
+// value. Results that only apply when the loop runs at least once are
+// wrapped in a loop that ends with SET_CONST(0) on the counter, so it
+// executes at most once.
+#define AFFINE_MAX_CELLS 16
+
+typedef struct {
+    int count;
+    int offset[AFFINE_MAX_CELLS];                   // Offset of each tracked cell
+    int constant[AFFINE_MAX_CELLS];                 // value = constant + sum coef * x_j
+    int coef[AFFINE_MAX_CELLS][AFFINE_MAX_CELLS];
+} affine_state_t;
+
+typedef enum {
+    AFFINE_INVARIANT,       // Never changes
+    AFFINE_ACCUMULATOR,     // Adds a loop-invariant amount every iteration
+    AFFINE_RESET,           // Overwritten with a loop-invariant value every iteration
+    AFFINE_OTHER,
+} affine_kind_t;
+
+// Index of the cell at offset, tracking it with the identity form if new;
+// -1 when too many cells are involved
+static int affine_cell(affine_state_t *st, int offset) {
+    for (int i = 0; i < st->count; i++) {
+        if (st->offset[i] == offset) return i;
+    }
+    if (st->count == AFFINE_MAX_CELLS) return -1;
+
+    int i = st->count++;
+    st->offset[i] = offset;
+    st->constant[i] = 0;
+    for (int j = 0; j < AFFINE_MAX_CELLS; j++) {
+        st->coef[i][j] = 0;
+        st->coef[j][i] = 0;
+    }
+    st->coef[i][i] = 1;
+    return i;
+}
+
+// Execute one iteration of the loop body symbolically
+static bool affine_execute(ast_node_t *body, affine_state_t *st) {
+    int delta = 0;
+
+    st->count = 0;
+    if (affine_cell(st, 0) != 0) return false;
+
+    for (ast_node_t *op = body; op; op = op->next) {
+        int k, j;
+        switch (op->type) {
+            case AST_MOVE_PTR:
+                delta += op->data.basic.count;
+                break;
+            case AST_ADD_VAL:
+                if ((k = affine_cell(st, delta + op->data.basic.offset)) < 0) return false;
+                st->constant[k] = (st->constant[k] + op->data.basic.count) & 0xFF;
+                break;
+            case AST_SET_CONST:
+                if ((k = affine_cell(st, delta + op->data.basic.offset)) < 0) return false;
+                st->constant[k] = op->data.basic.count & 0xFF;
+                for (int i = 0; i < AFFINE_MAX_CELLS; i++) st->coef[k][i] = 0;
+                break;
+            case AST_MUL: {
+                int m = op->data.mul.multiplier;
+                if ((j = affine_cell(st, delta + op->data.mul.src_offset)) < 0) return false;
+                if ((k = affine_cell(st, delta + op->data.mul.dst_offset)) < 0) return false;
+                int src_constant = st->constant[j];
+                int src_coef[AFFINE_MAX_CELLS];
+                memcpy(src_coef, st->coef[j], sizeof(src_coef));
+                st->constant[k] = (st->constant[k] + m * src_constant) & 0xFF;
+                for (int i = 0; i < AFFINE_MAX_CELLS; i++) {
+                    st->coef[k][i] = (st->coef[k][i] + m * src_coef[i]) & 0xFF;
+                }
+                break;
+            }
+            default:
+                return false;   // I/O, nested loops, scans, MUL2
+        }
     }
-    if (node->next) {
-        node->next = ast_optimize(node->next);
+
+    return delta == 0;
+}
+
+static bool affine_is_invariant(affine_state_t *st, int k) {
+    if (st->constant[k] != 0) return false;
+    for (int i = 0; i < st->count; i++) {
+        if (st->coef[k][i] != (i == k)) return false;
     }
+    return true;
+}
 
-    // Clear loop optimization: detect [-] pattern
-    if (node->type == AST_LOOP && node->data.loop.body &&
-        node->data.loop.body->type == AST_ADD_VAL && node->data.loop.body->data.basic.count == -1 &&
-        !node->data.loop.body->next) {
-        // Replace loop with set constant zero operation - preserve location
-        ast_free(node->data.loop.body);
-        node->type = AST_SET_CONST;
-        node->data.basic.count = 0;
-        node->data.basic.offset = 0;
-        // Location is already preserved in node
+// Classify cell k given which cells are invariant
+static affine_kind_t affine_classify(affine_state_t *st, int k, const bool *invariant) {
+    if (invariant[k]) return AFFINE_INVARIANT;
+    for (int i = 0; i < st->count; i++) {
+        if (i != k && st->coef[k][i] != 0 && !invariant[i]) return AFFINE_OTHER;
     }
+    if (st->coef[k][k] == 1) return AFFINE_ACCUMULATOR;
+    if (st->coef[k][k] == 0) return AFFINE_RESET;
+    return AFFINE_OTHER;
+}
 
-    // Multiplication loop optimization: detect loops with only ADD_VAL operations
-    if (node->type == AST_LOOP && node->data.loop.body && is_multiplication_loop(node)) {
-        ast_node_t *loop_body = node->data.loop.body;
+// Convert a byte coefficient to the signed range so +-1 hit the fast paths
+static int affine_byte(int value) {
+    value &= 0xFF;
+    return value >= 128 ? value - 256 : value;
+}
 
-        // CRITICAL: Capture the next node BEFORE we free loop_body
-        ast_node_t *original_next = node->next;
+static void affine_append(ast_node_t **tail, ast_node_t *node, ast_node_t *loop) {
+    ast_copy_location(node, loop);
+    (*tail)->next = node;
+    *tail = node;
+}
+
+// Rewrite loop in place with its closed form; false if the body is not affine
+static bool affine_rewrite(ast_node_t *loop) {
+    affine_state_t st;
+    bool invariant[AFFINE_MAX_CELLS];
+    affine_kind_t kind[AFFINE_MAX_CELLS];
 
-        // Create individual MUL nodes for each ADD_VAL operation (except counter decrement)
-        ast_node_t *first_mul = NULL;
-        ast_node_t *last_mul = NULL;
+    if (!affine_execute(loop->data.loop.body, &st)) return false;
+
+    // The counter must only step by an odd constant
+    int step = st.constant[0];
+    if (!(step & 1)) return false;
+    for (int i = 0; i < st.count; i++) {
+        if (st.coef[0][i] != (i == 0)) return false;
+    }
 
-        for (ast_node_t *op = loop_body; op; op = op->next) {
-            if (op->type == AST_ADD_VAL && op->data.basic.offset != 0) {
-                ast_node_t *new_node;
+    // Iterations = counter * inverse(-step) (mod 256)
+    int scale = 1;
+    while (((scale * (256 - step)) & 0xFF) != 1) scale += 2;
 
-                // Create MUL node directly (multiplier = 1 is handled in codegen)
-                new_node = ast_create_mul(op->data.basic.count, 0, op->data.basic.offset);
+    for (int i = 0; i < st.count; i++) {
+        invariant[i] = i != 0 && affine_is_invariant(&st, i);
+    }
 
-                // Preserve location from original loop
-                ast_copy_location(new_node, node);
+    bool has_reset = false;
+    bool peel = false;
+    for (int k = 1; k < st.count; k++) {
+        kind[k] = affine_classify(&st, k, invariant);
+        if (kind[k] == AFFINE_RESET) has_reset = true;
+    }
 
-                if (!first_mul) {
-                    first_mul = last_mul = new_node;
-                } else {
-                    last_mul->next = new_node;
-                    last_mul = new_node;
+    // A cell reading a reset cell sees the reset value from the second
+    // iteration on: substitute it, peel the first iteration and classify
+    // the remaining iterations again
+    for (int k = 1; k < st.count; k++) {
+        for (int r = 1; r < st.count; r++) {
+            if (kind[k] == AFFINE_OTHER && kind[r] == AFFINE_RESET && r != k && st.coef[k][r] != 0) peel = true;
+        }
+    }
+    if (peel) {
+        for (int k = 1; k < st.count; k++) {
+            if (kind[k] == AFFINE_RESET) continue;
+            for (int r = 1; r < st.count; r++) {
+                int a = st.coef[k][r];
+                if (a == 0 || kind[r] != AFFINE_RESET) continue;
+                st.constant[k] = (st.constant[k] + a * st.constant[r]) & 0xFF;
+                for (int i = 0; i < st.count; i++) {
+                    st.coef[k][i] = (st.coef[k][i] + a * st.coef[r][i]) & 0xFF;
                 }
+                st.coef[k][r] = 0;
             }
         }
+        for (int i = 1; i < st.count; i++) {
+            invariant[i] = kind[i] != AFFINE_RESET && affine_is_invariant(&st, i);
+        }
+        for (int k = 1; k < st.count; k++) {
+            if (kind[k] == AFFINE_RESET) continue;
+            // A cell only overwritten from the second iteration on would
+            // need its own n >= 2 guard
+            kind[k] = affine_classify(&st, k, invariant);
+            if (kind[k] == AFFINE_RESET) return false;
+        }
+    }
+    for (int k = 1; k < st.count; k++) {
+        if (kind[k] == AFFINE_OTHER) return false;
+    }
 
-        // Add SET_CONST(0) to clear the counter
-        ast_node_t *clear_counter = ast_create_set_const(0, 0);
-        ast_copy_location(clear_counter, node); // Preserve location from original loop
-        if (last_mul) {
-            last_mul->next = clear_counter;
-        } else {
-            first_mul = clear_counter;
+    // Build the replacement after a dummy head
+    ast_node_t head;
+    ast_node_t *tail = &head;
+    head.next = NULL;
+
+    if (peel) {
+        for (ast_node_t *op = loop->data.loop.body; op; op = op->next) {
+            ast_node_t *copy = ast_create_node(op->type);
+            copy->data = op->data;
+            copy->line = op->line;
+            copy->column = op->column;
+            tail->next = copy;
+            tail = copy;
         }
-        clear_counter->next = original_next;
+    }
 
-        // Free the original loop
-        ast_free(loop_body);
+    for (int k = 1; k < st.count; k++) {
+        if (kind[k] == AFFINE_ACCUMULATOR) {
+            for (int j = 1; j < st.count; j++) {
+                int m = affine_byte(st.coef[k][j] * scale);
+                if (j != k && m != 0) {
+                    affine_append(&tail, ast_create_mul2(m, 0, st.offset[j], st.offset[k]), loop);
+                }
+            }
+            int m = affine_byte(st.constant[k] * scale);
+            if (m != 0) {
+                affine_append(&tail, ast_create_mul(m, 0, st.offset[k]), loop);
+            }
+        } else if (kind[k] == AFFINE_RESET && !peel) {
+            affine_append(&tail, ast_create_set_const(affine_byte(st.constant[k]), st.offset[k]), loop);
+            for (int j = 1; j < st.count; j++) {
+                int m = affine_byte(st.coef[k][j]);
+                if (m != 0) {
+                    affine_append(&tail, ast_create_mul(m, st.offset[j], st.offset[k]), loop);
+                }
+            }
+        }
+    }
+
+    // Clear the counter
+    affine_append(&tail, ast_create_set_const(0, 0), loop);
+
+    if (has_reset || peel) {
+        // Runs at most once: the body ends with the counter cleared
+        loop->data.loop.body = head.next;
+    } else {
+        ast_node_t *first = head.next;
+        tail->next = loop->next;
+        loop->type = first->type;
+        loop->data = first->data;
+        loop->next = first->next;
+    }
+
+    return true;
+}
 
-        // Replace current node with first MUL node
-        if (first_mul) {
-            // Directly copy the node data (removing memset that might cause issues)
-            node->type = first_mul->type;
-            node->data = first_mul->data;
-            node->next = first_mul->next;
-            node->line = first_mul->line;
-            node->column = first_mul->column;
+// Affine loops: multiplication loops such as [->+++>++<<], counters that
+// step by any odd amount, SET_CONST in the body and nested multiplication
+// loops become MUL / MUL2 / SET_CONST
+static int pass_mul(ast_node_t **list) {
+    int changed = 0;
 
-            // Free only the first_mul node structure, not its contents
-            free(first_mul);
+    for (ast_node_t *node = *list; node; node = node->next) {
+        if (node->type == AST_LOOP && node->data.loop.body && affine_rewrite(node)) {
+            changed++;
         }
+    }
 
-        return ast_optimize(node);
+    return changed;
+}
+
+// SET_CONST coalescing: fold an ADD_VAL into the SET_CONST before it, and
+// drop an ADD_VAL or SET_CONST that a SET_CONST right after it overwrites
+static int pass_setadd(ast_node_t **list) {
+    int changed = 0;
+    ast_node_t **link = list;
+
+    while (*link) {
+        ast_node_t *node = *link;
+        ast_node_t *next = node->next;
+
+        if (next && (node->type == AST_SET_CONST || node->type == AST_ADD_VAL) &&
+            next->type == AST_SET_CONST && node->data.basic.offset == next->data.basic.offset) {
+            *link = next;
+            changed++;
+            continue;
+        }
+        if (next && node->type == AST_SET_CONST && next->type == AST_ADD_VAL &&
+            node->data.basic.offset == next->data.basic.offset) {
+            node->data.basic.count += next->data.basic.count;
+            node->next = next->next;
+            changed++;
+            continue;
+        }
+        link = &node->next;
     }
 
-    // Set + Add coalescing: detect SET_CONST followed by ADD_VAL at same offset
-    if (node->type == AST_SET_CONST && node->next &&
-        node->next->type == AST_ADD_VAL && node->data.basic.offset == node->next->data.basic.offset) {
+    return changed;
+}
 
-        int final_value = node->data.basic.count + node->next->data.basic.count;
-        ast_node_t *add_node = node->next;
+// Known-value dataflow. Unlike the list passes this one walks the whole
+// tree from the program entry, where the pointer is at offset 0 and every
+// cell is zero, tracking which cells hold a known value and which stores
+// have not been read yet. Loops with balanced bodies keep the pointer
+// known and only forget the cells they write; anything else (scans,
+// unbalanced loops) starts a new frame where only the exit cell is known.
+#define KNOWN_UNKNOWN -1
+
+typedef struct {
+    long offset;                // Cell offset relative to the list entry
+    int value;                  // 0..255 or KNOWN_UNKNOWN
+    ast_node_t *store;          // Last write with no read since, if removable
+    bool used;
+} known_cell_t;
+
+typedef struct {
+    known_cell_t *cells;        // Open-addressed table, capacity a power of two
+    size_t capacity, count;
+    int other;                  // Value of cells not in the table
+    long delta;                 // Pointer relative to the frame origin
+} known_state_t;
+
+static void known_init(known_state_t *st, int other) {
+    st->capacity = 64;
+    st->count = 0;
+    st->cells = calloc(st->capacity, sizeof(known_cell_t));
+    if (!st->cells) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    st->other = other;
+    st->delta = 0;
+}
 
-        // Update SET_CONST with final value
-        node->data.basic.count = final_value;
-        node->next = add_node->next;
+static void known_copy(known_state_t *dst, const known_state_t *src) {
+    *dst = *src;
+    dst->cells = malloc(src->capacity * sizeof(known_cell_t));
+    if (!dst->cells) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    memcpy(dst->cells, src->cells, src->capacity * sizeof(known_cell_t));
+}
+
+// Forget everything: a new frame whose origin is the current pointer
+static void known_reset(known_state_t *st) {
+    memset(st->cells, 0, st->capacity * sizeof(known_cell_t));
+    st->count = 0;
+    st->other = KNOWN_UNKNOWN;
+    st->delta = 0;
+}
+
+static size_t known_hash(long offset, size_t capacity) {
+    return ((unsigned long)offset * 0x9E3779B97F4A7C15UL >> 17) & (capacity - 1);
+}
 
-        // Free the ADD_VAL node
-        free(add_node);
+// Cell at a pointer-relative offset; created from `other` if create is set
+static known_cell_t *known_cell(known_state_t *st, int offset, bool create) {
+    long key = wrap_offset(st->delta + offset);
+    size_t i = known_hash(key, st->capacity);
 
-        // Continue optimizing from current node
-        return ast_optimize(node);
+    while (st->cells[i].used) {
+        if (st->cells[i].offset == key) return &st->cells[i];
+        i = (i + 1) & (st->capacity - 1);
+    }
+    if (!create) return NULL;
+
+    if (2 * (st->count + 1) > st->capacity) {
+        known_cell_t *old = st->cells;
+        size_t old_capacity = st->capacity;
+        st->capacity *= 2;
+        st->cells = calloc(st->capacity, sizeof(known_cell_t));
+        if (!st->cells) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(1);
+        }
+        for (size_t j = 0; j < old_capacity; j++) {
+            if (!old[j].used) continue;
+            size_t k = known_hash(old[j].offset, st->capacity);
+            while (st->cells[k].used) k = (k + 1) & (st->capacity - 1);
+            st->cells[k] = old[j];
+        }
+        free(old);
+        return known_cell(st, offset, true);
     }
 
-    return node;
+    st->count++;
+    st->cells[i] = (known_cell_t){ .offset = key, .value = st->other, .store = NULL, .used = true };
+    return &st->cells[i];
 }
 
-// Sequence rewriting optimization: coalesce pointer movements and use offsets
-ast_node_t* ast_rewrite_sequences(ast_node_t *node) {
-    if (!node) return NULL;
+static int known_value(known_state_t *st, int offset) {
+    known_cell_t *cell = known_cell(st, offset, false);
+    return cell ? cell->value : st->other;
+}
 
-    // Process this level - find sequences of operations between control flow
-    ast_node_t *current = node;
-
-    while (current) {
-        // Find the start of a basic block (sequence without control flow)
-        ast_node_t *block_start = current;
-        ast_node_t *block_end = current;
-        int total_ptr_movement = 0;
-        int current_offset = 0;
-
-        // Scan forward to find the end of this basic block
-        bool has_ptr_movements = false;
-        while (block_end && block_end->type != AST_LOOP) {
-            if (block_end->type == AST_MOVE_PTR) {
-                total_ptr_movement += block_end->data.basic.count;
-                current_offset += block_end->data.basic.count;
-                has_ptr_movements = true;
-            }
+static void known_read(known_state_t *st, int offset) {
+    known_cell_t *cell = known_cell(st, offset, false);
+    if (cell) cell->store = NULL;
+}
+
+// Dead stores are turned into MOVE_PTR(0) and unlinked by known_sweep
+static void known_kill(ast_node_t *node) {
+    node->type = AST_MOVE_PTR;
+    node->data.basic.count = 0;
+    node->data.basic.offset = 0;
+}
+
+// Write value to the cell; store is the node doing it if it could be
+// removed should nothing read the cell before the next write
+static void known_write(known_state_t *st, int offset, int value, ast_node_t *store, int *changed) {
+    known_cell_t *cell = known_cell(st, offset, true);
+    if (cell->store) {
+        known_kill(cell->store);
+        (*changed)++;
+    }
+    cell->value = value;
+    cell->store = store;
+}
+
+// Everything may be read: no pending store can be dropped any more
+static void known_flush(known_state_t *st) {
+    for (size_t i = 0; i < st->capacity; i++) st->cells[i].store = NULL;
+}
 
-            // If this is the last node or next node is a loop, end the block
-            if (!block_end->next || block_end->next->type == AST_LOOP) {
+// Forget the cells body writes, as offsets from the current pointer.
+// Returns false if the body moves the pointer by a data-dependent or
+// non-zero amount.
+static bool known_clobber(known_state_t *st, ast_node_t *body) {
+    long start = st->delta;
+    bool balanced = true;
+
+    for (ast_node_t *node = body; node && balanced; node = node->next) {
+        switch (node->type) {
+            case AST_MOVE_PTR:
+                st->delta = wrap_offset(st->delta + node->data.basic.count);
+                break;
+            case AST_ADD_VAL:
+            case AST_SET_CONST:
+            case AST_INPUT:
+                known_cell(st, node->data.basic.offset, true)->value = KNOWN_UNKNOWN;
+                break;
+            case AST_MUL:
+            case AST_MUL2:
+                known_cell(st, node->data.mul.dst_offset, true)->value = KNOWN_UNKNOWN;
+                break;
+            case AST_LOOP:
+            case AST_IF:
+                balanced = known_clobber(st, node->data.loop.body);
+                break;
+            case AST_SCAN:
+                balanced = false;
+                break;
+            default:
                 break;
-            }
-            block_end = block_end->next;
         }
+    }
 
-        // Capture the next node before we modify the structure
-        ast_node_t *original_next = block_end ? block_end->next : NULL;
+    balanced = balanced && st->delta == start;
+    st->delta = start;
+    return balanced;
+}
 
-        // If we have a block with pointer movements, rewrite it
-        if (block_start != block_end && has_ptr_movements) {
-            ast_node_t *rewrite_current = block_start;
-            ast_node_t *first_move_node = NULL; // Track first MOVE_PTR for location
-            current_offset = 0;
+// A balanced body that ends by clearing its condition cell runs at most once
+static bool known_runs_once(ast_node_t *body) {
+    known_state_t probe;
+    ast_node_t *last = body;
 
-            while (rewrite_current && rewrite_current != original_next) {
-                if (rewrite_current->type == AST_MOVE_PTR) {
-                    current_offset += rewrite_current->data.basic.count;
+    if (!body) return false;
+    while (last->next) last = last->next;
+    if (last->type != AST_SET_CONST || last->data.basic.offset != 0 || (last->data.basic.count & 0xFF) != 0) {
+        return false;
+    }
 
-                    // Remember the first MOVE_PTR node for source location
-                    if (!first_move_node) {
-                        first_move_node = rewrite_current;
-                    }
+    known_init(&probe, KNOWN_UNKNOWN);
+    bool balanced = known_clobber(&probe, body);
+    free(probe.cells);
+    return balanced;
+}
 
-                    // Mark this MOVE_PTR for removal by setting count to 0
-                    rewrite_current->data.basic.count = 0;
+static void known_walk(ast_node_t **list, known_state_t *st, int *changed);
+
+// A loop whose body may run: work out the state the body starts in, walk
+// it, and leave st as the state after the loop
+static void known_loop(ast_node_t *node, known_state_t *st, int *changed) {
+    known_state_t inner;
+
+    known_flush(st);
+    known_copy(&inner, st);
+    if (known_clobber(&inner, node->data.loop.body)) {
+        known_cell(&inner, 0, true)->value = KNOWN_UNKNOWN;
+        known_walk(&node->data.loop.body, &inner, changed);
+        known_clobber(st, node->data.loop.body);
+    } else {
+        known_reset(&inner);
+        known_walk(&node->data.loop.body, &inner, changed);
+        known_reset(st);
+    }
+    free(inner.cells);
 
-                } else if (rewrite_current->type == AST_ADD_VAL) {
-                    // Update ADD_VAL to use current offset
-                    rewrite_current->data.basic.offset += current_offset;
+    // The loop exits on a zero cell
+    known_cell(st, 0, true)->value = 0;
+}
 
-                } else if (rewrite_current->type == AST_INPUT || rewrite_current->type == AST_OUTPUT) {
-                    // Update INPUT/OUTPUT to use current offset
-                    rewrite_current->data.basic.offset += current_offset;
+// An IF body runs at most once, straight from the state before it
+static void known_if(ast_node_t *node, known_state_t *st, int *changed) {
+    known_state_t inner;
 
-                } else if (rewrite_current->type == AST_SET_CONST) {
-                    // Update SET_CONST to use current offset
-                    rewrite_current->data.basic.offset += current_offset;
+    known_flush(st);
+    known_copy(&inner, st);
+    known_cell(&inner, 0, true)->value = KNOWN_UNKNOWN;
+    known_walk(&node->data.loop.body, &inner, changed);
+    free(inner.cells);
 
-                }  else if (rewrite_current->type == AST_MUL) {
-                    // Update MUL to use current offset
-                    rewrite_current->data.mul.src_offset += current_offset;
-                    rewrite_current->data.mul.dst_offset += current_offset;
+    // Either path leaves the condition cell zero
+    known_clobber(st, node->data.loop.body);
+    known_cell(st, 0, true)->value = 0;
+}
+
+static void known_walk(ast_node_t **list, known_state_t *st, int *changed) {
+    ast_node_t **link = list;
+
+    while (*link) {
+        ast_node_t *node = *link;
+        int value, src, src2;
+
+        switch (node->type) {
+            case AST_MOVE_PTR:
+                st->delta = wrap_offset(st->delta + node->data.basic.count);
+                break;
+
+            case AST_ADD_VAL:
+                value = known_value(st, node->data.basic.offset);
+                if (value != KNOWN_UNKNOWN) {
+                    // Known cell: the add becomes an assignment
+                    node->type = AST_SET_CONST;
+                    node->data.basic.count = (value + node->data.basic.count) & 0xFF;
+                    (*changed)++;
+                    continue;
                 }
+                known_read(st, node->data.basic.offset);
+                known_write(st, node->data.basic.offset, KNOWN_UNKNOWN, node, changed);
+                break;
 
-                rewrite_current = rewrite_current->next;
-            }
+            case AST_SET_CONST:
+                value = node->data.basic.count & 0xFF;
+                if (known_value(st, node->data.basic.offset) == value) {
+                    // Cell already holds it
+                    *link = node->next;
+                    (*changed)++;
+                    continue;
+                }
+                known_write(st, node->data.basic.offset, value, node, changed);
+                break;
 
-            // Add a single MOVE_PTR at the end if needed
-            if (total_ptr_movement != 0) {
-                ast_node_t *final_move = ast_create_move(total_ptr_movement);
-                if (first_move_node) {
-                    ast_copy_location(final_move, first_move_node);
+            case AST_OUTPUT:
+                known_read(st, node->data.basic.offset);
+                break;
+
+            case AST_INPUT:
+                // With --eof=unchanged the old value may survive
+                known_read(st, node->data.basic.offset);
+                known_write(st, node->data.basic.offset, KNOWN_UNKNOWN, NULL, changed);
+                break;
+
+            case AST_MUL:
+                src = known_value(st, node->data.mul.src_offset);
+                if (src != KNOWN_UNKNOWN) {
+                    // Constant source: the MUL is a plain add
+                    int count = affine_byte(src * node->data.mul.multiplier);
+                    int dst_offset = node->data.mul.dst_offset;
+                    (*changed)++;
+                    if (count == 0) {
+                        *link = node->next;
+                        continue;
+                    }
+                    node->type = AST_ADD_VAL;
+                    node->data.basic.count = count;
+                    node->data.basic.offset = dst_offset;
+                    continue;
                 }
-                final_move->next = original_next;
-                block_end->next = final_move;
-            }
+                known_read(st, node->data.mul.src_offset);
+                known_read(st, node->data.mul.dst_offset);
+                known_write(st, node->data.mul.dst_offset, KNOWN_UNKNOWN, node, changed);
+                break;
+
+            case AST_MUL2:
+                src = known_value(st, node->data.mul.src_offset);
+                src2 = known_value(st, node->data.mul.src2_offset);
+                if (src != KNOWN_UNKNOWN || src2 != KNOWN_UNKNOWN) {
+                    // One constant factor makes it a MUL
+                    int multiplier = node->data.mul.multiplier;
+                    (*changed)++;
+                    if (src != KNOWN_UNKNOWN) {
+                        multiplier *= src;
+                        node->data.mul.src_offset = node->data.mul.src2_offset;
+                    } else {
+                        multiplier *= src2;
+                    }
+                    if (affine_byte(multiplier) == 0) {
+                        *link = node->next;
+                        continue;
+                    }
+                    node->type = AST_MUL;
+                    node->data.mul.multiplier = affine_byte(multiplier);
+                    continue;
+                }
+                known_read(st, node->data.mul.src_offset);
+                known_read(st, node->data.mul.src2_offset);
+                known_read(st, node->data.mul.dst_offset);
+                known_write(st, node->data.mul.dst_offset, KNOWN_UNKNOWN, node, changed);
+                break;
+
+            case AST_SCAN:
+                if (known_value(st, 0) == 0) {
+                    *link = node->next;
+                    (*changed)++;
+                    continue;
+                }
+                known_flush(st);
+                known_reset(st);
+                known_cell(st, 0, true)->value = 0;
+                break;
+
+            case AST_LOOP:
+                value = known_value(st, 0);
+                if (value == 0) {
+                    // Never entered
+                    *link = node->next;
+                    (*changed)++;
+                    continue;
+                }
+                if (value != KNOWN_UNKNOWN && known_runs_once(node->data.loop.body)) {
+                    // Entered exactly once: splice the body in its place
+                    ast_node_t *last = node->data.loop.body;
+                    while (last->next) last = last->next;
+                    last->next = node->next;
+                    *link = node->data.loop.body;
+                    (*changed)++;
+                    continue;
+                }
+                known_loop(node, st, changed);
+                break;
+
+            case AST_IF:
+                value = known_value(st, 0);
+                if (value == 0) {
+                    *link = node->next;
+                    (*changed)++;
+                    continue;
+                }
+                if (value != KNOWN_UNKNOWN) {
+                    ast_node_t *last = node->data.loop.body;
+                    while (last->next) last = last->next;
+                    last->next = node->next;
+                    *link = node->data.loop.body;
+                    (*changed)++;
+                    continue;
+                }
+                known_if(node, st, changed);
+                break;
+
+            default:
+                break;
         }
 
-        // Move to next block
-        if (block_end && block_end->type == AST_LOOP) {
-            // Recursively process the loop body
-            if (block_end->data.loop.body) {
-                block_end->data.loop.body = ast_rewrite_sequences(block_end->data.loop.body);
+        link = &node->next;
+    }
+}
+
+// Unlink the stores known_kill turned into no-ops
+static void known_sweep(ast_node_t **list) {
+    ast_node_t **link = list;
+
+    while (*link) {
+        ast_node_t *node = *link;
+        if (node->type == AST_MOVE_PTR && node->data.basic.count == 0) {
+            *link = node->next;
+            continue;
+        }
+        if (ast_has_body(node)) known_sweep(&node->data.loop.body);
+        link = &node->next;
+    }
+}
+
+// Known values: fold adds, MULs, loops and scans on cells whose value is
+// known, and drop stores that are overwritten (or the program ends)
+// before anything reads them
+static int pass_known(ast_node_t **root) {
+    known_state_t st;
+    int changed = 0;
+
+    known_init(&st, 0);
+    known_walk(root, &st, &changed);
+
+    // Nothing reads the tape after the program ends
+    for (size_t i = 0; i < st.capacity; i++) {
+        if (st.cells[i].used && st.cells[i].store) {
+            known_kill(st.cells[i].store);
+            changed++;
+        }
+    }
+    free(st.cells);
+
+    known_sweep(root);
+    return changed;
+}
+
+// If-style loops: a loop whose balanced body ends with SET_CONST(0) on
+// the condition cell becomes an IF, compiled without the back-edge
+static int pass_if(ast_node_t **list) {
+    int changed = 0;
+
+    for (ast_node_t *node = *list; node; node = node->next) {
+        if (node->type == AST_LOOP && known_runs_once(node->data.loop.body)) {
+            node->type = AST_IF;
+            changed++;
+        }
+        ast_node_t *body = node->data.loop.body;
+        if (node->type == AST_IF && !body->next && body->type == AST_SET_CONST && body->data.basic.offset == 0) {
+            // Nothing left but the clear
+            node->type = AST_SET_CONST;
+            node->data.basic.count = 0;
+            node->data.basic.offset = 0;
+            changed++;
+        }
+    }
+
+    return changed;
+}
+
+const ast_pass_t ast_passes[] = {
+    { "rle",     "Merge runs of +-, <> and drop no-ops",        pass_rle,     NULL },
+    { "offsets", "Fold pointer moves into cell offsets",        pass_offsets, NULL },
+    { "clear",   "[-] / [+] become SET_CONST(0)",               pass_clear,   NULL },
+    { "scan",    "[>] / [<] / [>>>>] become SCAN",              pass_scan,    NULL },
+    { "mul",     "Affine loops become MUL / MUL2 / SET_CONST",  pass_mul,     NULL },
+    { "if",      "Loops that run at most once become IF",       pass_if,      NULL },
+    { "known",   "Fold known cell values, drop dead stores",    NULL,         pass_known },
+    { "setadd",  "Fold ADD_VAL into SET_CONST, drop dead sets", pass_setadd,  NULL },
+};
+const int ast_pass_count = sizeof(ast_passes) / sizeof(ast_passes[0]);
+
+const ast_pass_t* ast_find_pass(const char *name) {
+    for (int i = 0; i < ast_pass_count; i++) {
+        if (strcmp(ast_passes[i].name, name) == 0) return &ast_passes[i];
+    }
+    return NULL;
+}
+
+static double pass_time_ms(void) {
+    struct timespec ts;
+    if (clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+        return 0.0;
+    }
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+// Collect the root list and every loop body list, outermost first. The
+// array doubles as the work queue, so this needs no recursion.
+static ast_node_t ***collect_lists(ast_node_t **root, size_t *count) {
+    size_t capacity = 64, n = 0;
+    ast_node_t ***lists = malloc(capacity * sizeof(*lists));
+    if (!lists) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+
+    lists[n++] = root;
+    for (size_t i = 0; i < n; i++) {
+        for (ast_node_t *node = *lists[i]; node; node = node->next) {
+            if (!ast_has_body(node)) continue;
+            if (n == capacity) {
+                capacity *= 2;
+                lists = realloc(lists, capacity * sizeof(*lists));
+                if (!lists) {
+                    fprintf(stderr, "Memory allocation failed\n");
+                    exit(1);
+                }
             }
-            current = original_next;
-        } else {
-            current = original_next;
+            lists[n++] = &node->data.loop.body;
         }
     }
 
-    // Remove MOVE_PTR nodes with count=0 (marked for removal)
-    ast_node_t *prev = NULL;
-    current = node;
+    *count = n;
+    return lists;
+}
+
+// Run passes in order, repeating the whole sequence until a round changes
+// nothing (or AST_PASS_MAX_ROUNDS is reached). Every pass is one linear
+// walk over the tree. stats, if not NULL, has one zeroed entry per pass and
+// accumulates the time spent in it and its rewrites over all rounds; the
+// node counts are taken around its run in the first round, so each pass's
+// counts after are the next one's before.
+ast_node_t* ast_run_passes(ast_node_t *node, const ast_pass_t **passes, int pass_count, ast_pass_stats_t *stats) {
+    for (int round = 0; round < AST_PASS_MAX_ROUNDS; round++) {
+        bool changed = false;
+
+        for (int p = 0; p < pass_count; p++) {
+            if (stats && round == 0) ast_count_types(node, stats[p].nodes_before);
 
-    while (current) {
-        if (current->type == AST_MOVE_PTR && current->data.basic.count == 0) {
-            // Remove this node
-            if (prev) {
-                prev->next = current->next;
-                free(current);
-                current = prev->next;
+            double start = stats ? pass_time_ms() : 0.0;
+            int fired = 0;
+
+            if (passes[p]->run_tree) {
+                fired = passes[p]->run_tree(&node);
             } else {
-                // Removing the first node
-                node = current->next;
-                free(current);
-                current = node;
+                size_t count;
+                ast_node_t ***lists = collect_lists(&node, &count);
+
+                // Innermost lists first
+                for (size_t i = count; i-- > 0;) {
+                    fired += passes[p]->run(lists[i]);
+                }
+                free(lists);
+            }
+            if (fired) changed = true;
+
+            if (stats) {
+                stats[p].ms += pass_time_ms() - start;
+                stats[p].fired += fired;
+                if (round == 0) ast_count_types(node, stats[p].nodes_after);
             }
-        } else {
-            prev = current;
-            current = current->next;
         }
+
+        if (!changed) break;
     }
 
     return node;
 }
 
+// Run every pass in the default order
+ast_node_t* ast_optimize(ast_node_t *node) {
+    const ast_pass_t *passes[sizeof(ast_passes) / sizeof(ast_passes[0])];
+    for (int i = 0; i < ast_pass_count; i++) {
+        passes[i] = &ast_passes[i];
+    }
+    return ast_run_passes(node, passes, ast_pass_count, NULL);
+}
+
 int ast_count_nodes(ast_node_t *node) {
-    if (!node) return 0;
+    int count = 0;
 
-    int count = 1; // Count current node
+    // Walk siblings iteratively; only loop bodies recurse
+    for (; node; node = node->next) {
+        count++;
+        if (ast_has_body(node)) {
+            count += ast_count_nodes(node->data.loop.body);
+        }
+    }
 
-    // Count nodes in loop body if this is a loop
-    if (node->type == AST_LOOP && node->data.loop.body) {
-        count += ast_count_nodes(node->data.loop.body);
+    return count;
+}
+
+// Add the number of nodes of each type to counts (AST_TYPE_COUNT entries)
+void ast_count_types(ast_node_t *node, int *counts) {
+    for (; node; node = node->next) {
+        counts[node->type]++;
+        if (ast_has_body(node)) ast_count_types(node->data.loop.body, counts);
+    }
+}
+
+int ast_count_loops(ast_node_t *node) {
+    int count = 0;
+
+    for (; node; node = node->next) {
+        if (node->type == AST_LOOP) count++;
+        if (ast_has_body(node)) count += ast_count_loops(node->data.loop.body);
     }
 
-    // Count next node in sequence
-    if (node->next) {
-        count += ast_count_nodes(node->next);
+    return count;
+}
+
+int ast_count_ifs(ast_node_t *node) {
+    int count = 0;
+
+    for (; node; node = node->next) {
+        if (node->type == AST_IF) count++;
+        if (ast_has_body(node)) count += ast_count_ifs(node->data.loop.body);
     }
 
     return count;
 }
 
+// LOOP and IF nodes own a nested sibling list
+bool ast_has_body(const ast_node_t *node) {
+    return (node->type == AST_LOOP || node->type == AST_IF) && node->data.loop.body;
+}
+
+// Deep copy of node, its siblings and all loop bodies
+ast_node_t* ast_clone(ast_node_t *node) {
+    ast_node_t *head = NULL;
+    ast_node_t **link = &head;
+
+    for (; node; node = node->next) {
+        ast_node_t *copy = ast_create_node(node->type);
+        *copy = *node;
+        copy->next = NULL;
+        if (ast_has_body(node)) {
+            copy->data.loop.body = ast_clone(node->data.loop.body);
+        }
+        *link = copy;
+        link = &copy->next;
+    }
+
+    return head;
+}
+
 void ast_set_location(ast_node_t *node, int line, int column) {
     if (node) {
         node->line = line;
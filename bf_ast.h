@@ -3,6 +3,8 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
 
 typedef enum {
     AST_MOVE_PTR,       // > or < (with count for run-length)
@@ -15,27 +17,37 @@ typedef enum {
     // Optimized high-level operations
     AST_SET_CONST,      // Direct constant assignment (includes clear cell as SET_CONST(0))
     AST_MUL,            // Multiply current cell by multiplier and add to target offset
+    AST_SCAN,           // Move by stride until a zero cell is found ([>], [<], [>>>>])
+    AST_MUL2,           // Add multiplier * src * src2 to target offset (quadratic loop terms)
+    AST_IF,             // Loop whose body always clears the condition cell: runs at most once
 } ast_node_type_t;
 
+#define AST_TYPE_COUNT (AST_IF + 1)
+
 typedef struct ast_node {
     ast_node_type_t type;
     union {
         struct {
-            int count;            // For MOVE_PTR, ADD_VAL value, SET_CONST value
+            int count;            // For MOVE_PTR, ADD_VAL value, SET_CONST value, SCAN stride
             int offset;           // For ADD_VAL, INPUT, OUTPUT, SET_CONST (default 0 for current position)
         } basic;
         struct {
-            struct ast_node *body;  // For AST_LOOP only
+            struct ast_node *body;  // For AST_LOOP and AST_IF
         } loop;
         struct {
             int multiplier;         // Multiplier value
             int src_offset;         // Source offset to read from
             int dst_offset;         // Destination offset to add result to
+            int src2_offset;        // Second source offset (AST_MUL2 only)
         } mul;
     } data;
     struct ast_node *next;        // Next sibling in sequence
     int line, column;             // Source location for debugging
     int profile_samples;          // Sample count for profiler heat map
+    bool profiled;                // Counts below were measured (--pgo-in)
+    uint64_t profile_entries;     // LOOP/IF: times reached
+    uint64_t profile_iterations;  // LOOP/IF: times the body ran
+    uint64_t profile_runs;        // Other nodes: times the node ran (--count=nodes)
 } ast_node_t;
 
 // AST construction functions
@@ -50,15 +62,61 @@ ast_node_t* ast_create_sequence(ast_node_t *first, ast_node_t *second);
 // Optimized AST nodes
 ast_node_t* ast_create_set_const(int value, int offset);
 ast_node_t* ast_create_mul(int multiplier, int src_offset, int dst_offset);
+ast_node_t* ast_create_scan(int stride);
+ast_node_t* ast_create_mul2(int multiplier, int src_offset, int src2_offset, int dst_offset);
+
+// Arena functions. Nodes live in a per-thread arena that is released as a
+// whole: reset frees every node this thread allocated, compact copies the
+// tree at node into one contiguous array and frees all the rest, so any
+// other tree built on this thread is gone after either call.
+void ast_arena_reset(void);
+ast_node_t* ast_arena_compact(ast_node_t *node);
 
 // AST manipulation
-void ast_free(ast_node_t *node);
+ast_node_t* ast_clone(ast_node_t *node);
 void ast_print(ast_node_t *node, int indent);
+void ast_print_counts(ast_node_t *node, int indent);
 int ast_count_nodes(ast_node_t *node);
+void ast_count_types(ast_node_t *node, int *counts);
+int ast_count_loops(ast_node_t *node);
+int ast_count_ifs(ast_node_t *node);
+bool ast_has_body(const ast_node_t *node);
 void ast_set_location(ast_node_t *node, int line, int column);
 void ast_copy_location(ast_node_t *dst, ast_node_t *src);
+
+// Optimization passes. A pass rewrites one sibling list in place in a
+// single linear walk and returns how many rewrites it made; the pass
+// manager applies it to every list in the tree. Dataflow passes that need
+// the program entry state instead set run_tree and see the whole tree once.
+#define AST_PASS_MAX_ROUNDS 16
+
+typedef struct {
+    const char *name;                       // Name accepted by --passes
+    const char *description;                // One line for --help
+    int (*run)(ast_node_t **list);          // Rewrite one sibling list
+    int (*run_tree)(ast_node_t **root);     // Or rewrite the whole program
+} ast_pass_t;
+
+// What one pass did over all rounds (--timing, --stats)
+typedef struct {
+    double ms;                              // Time spent in the pass
+    long fired;                             // Rewrites it made
+    int nodes_before[AST_TYPE_COUNT];       // Nodes of each type before its first-round run
+    int nodes_after[AST_TYPE_COUNT];        // And after it
+} ast_pass_stats_t;
+
+extern const ast_pass_t ast_passes[];   // All passes, in default order
+extern const int ast_pass_count;
+
+// Cells in a tape that wraps (the masked tape of safe mode), or 0 for one
+// that does not. Offsets that differ by a multiple of it name the same
+// cell, so the passes reduce them to one offset near zero. Per thread, like
+// the arena; set it before running passes.
+void ast_set_tape_wrap(size_t cells);
+
+const ast_pass_t* ast_find_pass(const char *name);
+ast_node_t* ast_run_passes(ast_node_t *node, const ast_pass_t **passes, int pass_count, ast_pass_stats_t *stats);
 ast_node_t* ast_optimize(ast_node_t *node);
-ast_node_t* ast_rewrite_sequences(ast_node_t *node);
 
 // AST traversal for code generation is in bf.c to access static DynASM functions
 
@@ -0,0 +1,289 @@
+#define _GNU_SOURCE
+#include "bf_batch.h"
+#include "bf_tape.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+
+// Inputs a worker may run ahead of the output writer, per worker, so
+// buffered outputs stay bounded when one input is slow
+#define BATCH_WINDOW_PER_JOB 4
+
+typedef struct {
+    const char *path;           // Input file, or NULL for an in-memory record
+    unsigned char *data;
+    size_t size;
+    bool owned;                 // data was read from path and is freed here
+    unsigned char *output;
+    size_t output_size;
+    size_t output_capacity;
+    size_t input_pos;
+    bool failed;
+    bool done;
+} batch_job_t;
+
+typedef struct {
+    const bf_batch_t *batch;
+    batch_job_t *jobs;
+    int count;
+    int next;                   // Next job to hand out
+    int emitted;                // Jobs already written to the output
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+} batch_state_t;
+
+static ssize_t job_read(void *ctx, void *buf, size_t size) {
+    batch_job_t *job = ctx;
+    size_t left = job->size - job->input_pos;
+    if (size > left) size = left;
+    memcpy(buf, job->data + job->input_pos, size);
+    job->input_pos += size;
+    return (ssize_t)size;
+}
+
+static ssize_t job_write(void *ctx, const void *buf, size_t size) {
+    batch_job_t *job = ctx;
+    if (job->output_size + size > job->output_capacity) {
+        size_t capacity = job->output_capacity ? job->output_capacity : 4096;
+        while (capacity < job->output_size + size) capacity *= 2;
+        unsigned char *grown = realloc(job->output, capacity);
+        if (!grown) {
+            errno = ENOMEM;
+            return -1;
+        }
+        job->output = grown;
+        job->output_capacity = capacity;
+    }
+    memcpy(job->output + job->output_size, buf, size);
+    job->output_size += size;
+    return (ssize_t)size;
+}
+
+static int load_file(batch_job_t *job) {
+    int fd = open(job->path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    size_t capacity = 0;
+    for (;;) {
+        if (job->size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            unsigned char *grown = realloc(job->data, capacity);
+            if (!grown) break;
+            job->data = grown;
+        }
+        ssize_t n = read(fd, job->data + job->size, capacity - job->size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            close(fd);
+            return n == 0 ? 0 : -1;
+        }
+        job->size += (size_t)n;
+    }
+    close(fd);
+    return -1;
+}
+
+static void *batch_worker(void *arg) {
+    batch_state_t *state = arg;
+    const bf_batch_t *batch = state->batch;
+    int window = batch->jobs * BATCH_WINDOW_PER_JOB;
+
+    bf_tape_t tape = { 0 };
+    char *memory = NULL;
+    if (batch->grow_tape) {
+        if (bf_tape_reserve(&tape, batch->memory_size, batch->memory_offset, batch->hugepages) == 0) {
+            memory = tape.start;
+        }
+    } else {
+        memory = allocate_guarded_memory(batch->memory_size);
+    }
+    bf_io_t *io = malloc(sizeof(bf_io_t));
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t tape_bytes = (batch->memory_size + page_size - 1) & ~(page_size - 1);
+
+    for (;;) {
+        pthread_mutex_lock(&state->lock);
+        while (state->next < state->count && state->next >= state->emitted + window) {
+            pthread_cond_wait(&state->changed, &state->lock);
+        }
+        int i = state->next < state->count ? state->next++ : -1;
+        pthread_mutex_unlock(&state->lock);
+        if (i < 0) break;
+
+        batch_job_t *job = &state->jobs[i];
+        if (!memory || !io) {
+            job->failed = true;
+        } else if (job->path && load_file(job) != 0) {
+            fprintf(stderr, "Error: Could not read '%s'\n", job->path);
+            job->failed = true;
+        } else {
+            // Every input starts from a zeroed tape, including the cells
+            // unsafe code can reach past memory_size before the guard page;
+            // a growable tape drops what the last input committed instead
+            if (batch->grow_tape) {
+                bf_tape_reset(&tape);
+            } else {
+                memset(memory, 0, tape_bytes);
+            }
+            bf_io_callbacks_t callbacks = { job_read, job_write, job };
+            bf_io_init_callbacks(io, &callbacks, batch->eof_mode);
+            io->debug_log = bf_codegen_debug_log;
+
+            batch->code(batch->grow_tape ? memory : memory + batch->memory_offset, io);
+            bf_io_flush(io);
+            job->failed = io->error != 0;
+        }
+        if (job->owned) {
+            free(job->data);
+            job->data = NULL;
+        }
+
+        pthread_mutex_lock(&state->lock);
+        job->done = true;
+        pthread_cond_broadcast(&state->changed);
+        pthread_mutex_unlock(&state->lock);
+    }
+
+    free(io);
+    if (batch->grow_tape) {
+        bf_tape_release(&tape);
+    } else {
+        free_guarded_memory(memory, batch->memory_size);
+    }
+    return NULL;
+}
+
+static int write_all(int fd, const unsigned char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        data += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Start the workers, then write each output as soon as it and all outputs
+// before it are done
+static int batch_run(const bf_batch_t *batch, batch_job_t *jobs, int count, int out_fd) {
+    batch_state_t state = { .batch = batch, .jobs = jobs, .count = count };
+    pthread_mutex_init(&state.lock, NULL);
+    pthread_cond_init(&state.changed, NULL);
+
+    int jobs_wanted = batch->jobs < 1 ? 1 : batch->jobs;
+    pthread_t *threads = malloc((size_t)jobs_wanted * sizeof(pthread_t));
+    int started = 0;
+    while (threads && started < jobs_wanted &&
+           pthread_create(&threads[started], NULL, batch_worker, &state) == 0) {
+        started++;
+    }
+    if (started == 0) {
+        fprintf(stderr, "Error: Could not start batch workers\n");
+        free(threads);
+        pthread_cond_destroy(&state.changed);
+        pthread_mutex_destroy(&state.lock);
+        return -1;
+    }
+
+    int ret = 0;
+    for (int i = 0; i < count; i++) {
+        pthread_mutex_lock(&state.lock);
+        while (!jobs[i].done) {
+            pthread_cond_wait(&state.changed, &state.lock);
+        }
+        pthread_mutex_unlock(&state.lock);
+
+        if (jobs[i].failed) ret = -1;
+        if (write_all(out_fd, jobs[i].output, jobs[i].output_size) != 0) {
+            perror("Error: write failed");
+            ret = -1;
+        }
+        free(jobs[i].output);
+        jobs[i].output = NULL;
+
+        pthread_mutex_lock(&state.lock);
+        state.emitted = i + 1;
+        pthread_cond_broadcast(&state.changed);
+        pthread_mutex_unlock(&state.lock);
+    }
+
+    for (int t = 0; t < started; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    free(threads);
+    pthread_cond_destroy(&state.changed);
+    pthread_mutex_destroy(&state.lock);
+    return ret;
+}
+
+int bf_batch_run_files(const bf_batch_t *batch, char *const *paths, int count, int out_fd) {
+    batch_job_t *jobs = calloc((size_t)(count > 0 ? count : 1), sizeof(batch_job_t));
+    if (!jobs) {
+        perror("calloc");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++) {
+        jobs[i].path = paths[i];
+        jobs[i].owned = true;
+    }
+
+    int ret = batch_run(batch, jobs, count, out_fd);
+    free(jobs);
+    return ret;
+}
+
+int bf_batch_run_records(const bf_batch_t *batch, int in_fd, char delimiter, int out_fd) {
+    // Records point into one copy of the whole input
+    batch_job_t input = { 0 };
+    input.path = NULL;
+    unsigned char chunk[65536];
+    for (;;) {
+        ssize_t n = read(in_fd, chunk, sizeof(chunk));
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("Error: read failed");
+            free(input.output);
+            return -1;
+        }
+        if (n == 0) break;
+        if (job_write(&input, chunk, (size_t)n) < 0) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+
+    int count = 0, capacity = 0;
+    batch_job_t *jobs = NULL;
+    size_t start = 0;
+    while (start < input.output_size) {
+        unsigned char *end = memchr(input.output + start, delimiter, input.output_size - start);
+        size_t size = end ? (size_t)(end - (input.output + start)) : input.output_size - start;
+
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            batch_job_t *grown = realloc(jobs, (size_t)capacity * sizeof(batch_job_t));
+            if (!grown) {
+                perror("realloc");
+                exit(1);
+            }
+            jobs = grown;
+        }
+        memset(&jobs[count], 0, sizeof(batch_job_t));
+        jobs[count].data = input.output + start;
+        jobs[count].size = size;
+        count++;
+
+        start += size + 1;
+    }
+
+    int ret = batch_run(batch, jobs, count, out_fd);
+    free(jobs);
+    free(input.output);
+    return ret;
+}
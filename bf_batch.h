@@ -0,0 +1,30 @@
+#ifndef BF_BATCH_H
+#define BF_BATCH_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "bf_codegen.h"
+
+#define BATCH_MAX_JOBS 256
+
+// Batch mode (--batch): one compiled program over many inputs on a pool
+// of worker threads. Each worker owns a guarded or growable tape, cleared
+// before every input, and its own I/O state; outputs are written in input
+// order.
+typedef struct {
+    bf_func code;
+    bf_eof_mode_t eof_mode;
+    size_t memory_size;         // Tape bytes per worker
+    size_t memory_offset;       // Initial cell
+    bool grow_tape;             // Growable tapes of memory_size bytes (code compiled unsafe)
+    bool hugepages;             // Growable tapes use huge pages
+    int jobs;                   // Worker threads
+} bf_batch_t;
+
+// Batch functions. Run code once per input file, or once per record of
+// in_fd split at delimiter (not part of the record). Returns 0, or -1 if
+// an input could not be read or the output could not be written.
+int bf_batch_run_files(const bf_batch_t *batch, char *const *paths, int count, int out_fd);
+int bf_batch_run_records(const bf_batch_t *batch, int in_fd, char delimiter, int out_fd);
+
+#endif // BF_BATCH_H
@@ -0,0 +1,232 @@
+#include "bf_cache.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// Cache file layout: header, debug map entries, then the machine code at a
+// page-aligned offset so it can be mapped executable straight from the file.
+#define BF_CACHE_MAGIC 0x43464a42  // "BJFC"
+#define BF_CACHE_VERSION 5
+
+#if defined(__x86_64__) || defined(__x86_64) || defined(__amd64__) || defined(__amd64)
+#define BF_CACHE_ARCH 1
+#elif defined(__aarch64__) || defined(__arm64__)
+#define BF_CACHE_ARCH 2
+#else
+#define BF_CACHE_ARCH 0
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t arch;
+    uint32_t entry_count;       // debug_map_entry_t records after the header
+    uint64_t key;               // bf_cache_key() of source and flags
+    uint64_t memory_mask;
+    uint32_t unsafe_mode;
+    uint32_t eof_mode;
+    uint32_t optimize;
+    uint32_t cpu_features;
+    uint64_t peval_steps;
+    uint64_t pgo_hash;
+    uint64_t code_offset;       // Page-aligned file offset of the code
+    uint64_t code_size;
+    uint64_t exit_offset;       // bf_debug_info_t.exit_offset and cold_offset
+    uint64_t cold_offset;
+} bf_cache_header_t;
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+uint64_t bf_cache_key(const char *source, size_t source_size, const bf_cache_flags_t *flags) {
+    uint32_t version = BF_CACHE_VERSION;
+    uint32_t arch = BF_CACHE_ARCH;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    hash = fnv1a(hash, &version, sizeof(version));
+    hash = fnv1a(hash, &arch, sizeof(arch));
+    hash = fnv1a(hash, &flags->memory_mask, sizeof(flags->memory_mask));
+    hash = fnv1a(hash, &flags->unsafe_mode, sizeof(flags->unsafe_mode));
+    hash = fnv1a(hash, &flags->eof_mode, sizeof(flags->eof_mode));
+    hash = fnv1a(hash, &flags->optimize, sizeof(flags->optimize));
+    hash = fnv1a(hash, &flags->cpu_features, sizeof(flags->cpu_features));
+    hash = fnv1a(hash, &flags->peval_steps, sizeof(flags->peval_steps));
+    hash = fnv1a(hash, &flags->pgo_hash, sizeof(flags->pgo_hash));
+    if (flags->passes) {
+        hash = fnv1a(hash, flags->passes, strlen(flags->passes) + 1);
+    }
+    hash = fnv1a(hash, &flags->codegen_id, sizeof(flags->codegen_id));
+    hash = fnv1a(hash, &source_size, sizeof(source_size));
+    return fnv1a(hash, source, source_size);
+}
+
+static void cache_path(char *path, size_t size, const char *dir, uint64_t key) {
+    snprintf(path, size, "%s/%016llx.bfjit", dir, (unsigned long long)key);
+}
+
+static size_t page_align(size_t size) {
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    return (size + page - 1) & ~(page - 1);
+}
+
+static int read_all(int fd, void *data, size_t size) {
+    char *p = data;
+    while (size > 0) {
+        ssize_t n = read(fd, p, size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+// Map a cached program. Returns the executable code, or NULL when there is
+// no valid entry for key (missing, stale, truncated or not mappable), in
+// which case the caller compiles as usual. Fills debug from the stored map.
+void *bf_cache_load(const char *dir, uint64_t key, const bf_cache_flags_t *flags, size_t *code_size, bf_debug_info_t *debug) {
+    char path[4096];
+    cache_path(path, sizeof(path), dir, key);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return NULL;
+
+    bf_cache_header_t header;
+    struct stat st;
+    if (read_all(fd, &header, sizeof(header)) != 0 ||
+        fstat(fd, &st) != 0 ||
+        header.magic != BF_CACHE_MAGIC ||
+        header.version != BF_CACHE_VERSION ||
+        header.arch != BF_CACHE_ARCH ||
+        header.key != key ||
+        header.memory_mask != flags->memory_mask ||
+        header.unsafe_mode != flags->unsafe_mode ||
+        header.eof_mode != flags->eof_mode ||
+        header.optimize != flags->optimize ||
+        header.cpu_features != flags->cpu_features ||
+        header.peval_steps != flags->peval_steps ||
+        header.pgo_hash != flags->pgo_hash ||
+        header.code_size == 0 ||
+        header.code_offset < sizeof(header) + (uint64_t)header.entry_count * sizeof(debug_map_entry_t) ||
+        header.exit_offset > header.code_size ||
+        header.cold_offset > header.code_size ||
+        (uint64_t)st.st_size < header.code_offset + header.code_size) {
+        close(fd);
+        return NULL;
+    }
+
+    if (debug) {
+        size_t entries_size = (size_t)header.entry_count * sizeof(debug_map_entry_t);
+        if ((int)header.entry_count > debug->max_entries) {
+            debug_map_entry_t *entries = realloc(debug->entries, entries_size);
+            if (!entries) {
+                close(fd);
+                return NULL;
+            }
+            debug->entries = entries;
+            debug->max_entries = (int)header.entry_count;
+        }
+        if (entries_size > 0 && read_all(fd, debug->entries, entries_size) != 0) {
+            close(fd);
+            return NULL;
+        }
+        debug->entry_count = (int)header.entry_count;
+        debug->exit_offset = (size_t)header.exit_offset;
+        debug->cold_offset = (size_t)header.cold_offset;
+        for (int i = 0; i < debug->entry_count; i++) {
+            debug->entries[i].node = NULL;  // Stored pointers belong to the writing process
+        }
+    }
+
+    void *code = mmap(NULL, header.code_size, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, (off_t)header.code_offset);
+    close(fd);
+    if (code == MAP_FAILED) {
+        if (debug) debug->entry_count = 0;
+        return NULL;
+    }
+
+    *code_size = header.code_size;
+    return code;
+}
+
+// Write a compiled program to the cache. The file is written under a
+// temporary name and renamed into place, so concurrent runs only ever see
+// complete entries. Returns 0 on success, -1 on failure.
+int bf_cache_store(const char *dir, uint64_t key, const bf_cache_flags_t *flags, const void *code, size_t code_size, const bf_debug_info_t *debug) {
+    char path[4096];
+    char tmp_path[4096 + 32];
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST) return -1;
+
+    cache_path(path, sizeof(path), dir, key);
+    snprintf(tmp_path, sizeof(tmp_path), "%s.%ld.tmp", path, (long)getpid());
+
+    uint32_t entry_count = debug ? (uint32_t)debug->entry_count : 0;
+    size_t entries_size = (size_t)entry_count * sizeof(debug_map_entry_t);
+    size_t code_offset = page_align(sizeof(bf_cache_header_t) + entries_size);
+
+    bf_cache_header_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = BF_CACHE_MAGIC;
+    header.version = BF_CACHE_VERSION;
+    header.arch = BF_CACHE_ARCH;
+    header.entry_count = entry_count;
+    header.key = key;
+    header.memory_mask = flags->memory_mask;
+    header.unsafe_mode = flags->unsafe_mode;
+    header.eof_mode = flags->eof_mode;
+    header.optimize = flags->optimize;
+    header.cpu_features = flags->cpu_features;
+    header.peval_steps = flags->peval_steps;
+    header.pgo_hash = flags->pgo_hash;
+    header.code_offset = code_offset;
+    header.code_size = code_size;
+    header.exit_offset = debug ? debug->exit_offset : 0;
+    header.cold_offset = debug ? debug->cold_offset : 0;
+
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) return -1;
+
+    size_t padding_size = code_offset - sizeof(header) - entries_size;
+    char *padding = calloc(1, padding_size ? padding_size : 1);
+    int ret = padding ? 0 : -1;
+
+    if (ret == 0) ret = write_all(fd, &header, sizeof(header));
+    if (ret == 0 && entries_size > 0) ret = write_all(fd, debug->entries, entries_size);
+    if (ret == 0) ret = write_all(fd, padding, padding_size);
+    if (ret == 0) ret = write_all(fd, code, code_size);
+    free(padding);
+
+    if (close(fd) != 0) ret = -1;
+    if (ret == 0 && rename(tmp_path, path) != 0) ret = -1;
+    if (ret != 0) unlink(tmp_path);
+    return ret;
+}
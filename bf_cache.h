@@ -0,0 +1,27 @@
+#ifndef BF_CACHE_H
+#define BF_CACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "bf_debug.h"
+
+// Everything that changes the generated code. All of it goes into the
+// cache key, and the numeric fields are checked again on load.
+typedef struct {
+    uint64_t memory_mask;       // Safe mode address mask (tape size - 1)
+    uint32_t unsafe_mode;       // --unsafe
+    uint32_t eof_mode;          // --eof convention baked into ','
+    uint32_t optimize;          // AST optimizations enabled
+    uint32_t cpu_features;      // ISA extensions codegen selected (e.g. AVX2)
+    uint64_t peval_steps;       // Partial evaluation budget (0 when disabled)
+    uint64_t pgo_hash;          // --pgo-in profile contents (0 without one)
+    const char *passes;         // Comma-separated optimization passes that ran
+    uint64_t codegen_id;        // bf_codegen_id() of the code generator that emitted it
+} bf_cache_flags_t;
+
+// Cache functions
+uint64_t bf_cache_key(const char *source, size_t source_size, const bf_cache_flags_t *flags);
+void *bf_cache_load(const char *dir, uint64_t key, const bf_cache_flags_t *flags, size_t *code_size, bf_debug_info_t *debug);
+int bf_cache_store(const char *dir, uint64_t key, const bf_cache_flags_t *flags, const void *code, size_t code_size, const bf_debug_info_t *debug);
+
+#endif // BF_CACHE_H
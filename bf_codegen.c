@@ -0,0 +1,1148 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <stdbool.h>
+#include <pthread.h>
+
+#include "bf_codegen.h"
+
+// Loops the profile never saw run are compiled out of line, after the
+// epilogue; cold_code is set while compiling them
+typedef struct {
+    ast_node_t *node;
+    int start_label;
+    int end_label;
+} cold_loop_t;
+
+// Peephole state: what the code emitted so far is known to leave in the
+// flags and scratch registers, so an emitter can skip recomputing it (the
+// architecture files say which registers). Emitters that do not keep it up
+// to date reset it, and so does every label, except where the compiler
+// knows the state on all the edges into it.
+typedef struct {
+    bool cell_tested;           // The current cell's value is at hand (flags or cell_reg)
+    int cell_reg;               // Register holding it, where the architecture uses one
+    bool index_valid;           // The scratch index register addresses the cell at index_offset
+    long index_offset;
+} bf_peep_t;
+
+// Entry of a lazy loop's slot: compiled fragments are called the same way
+// and ignore the slot argument
+typedef struct lazy_slot lazy_slot_t;
+typedef long (*lazy_entry_t)(char *memory, bf_io_t *io, long offset, lazy_slot_t *slot);
+
+struct lazy_slot {
+    lazy_entry_t entry;         // Called by the stub; first member, the stub loads it from the slot address
+    ast_node_t *node;           // Loop the stub stands for
+    bf_lazy_t *lazy;
+    void *code;                 // Compiled body, NULL until first entered
+    size_t code_size;
+    lazy_slot_t *next;
+};
+
+struct bf_lazy {
+    bf_codegen_options_t options;   // Fragment options the loops are compiled with
+    pthread_mutex_t lock;           // Held while resolving, which also adds the slots of nested stubs
+    lazy_slot_t *slots;
+    int stub_count;
+};
+
+// State of one compilation. DynASM's Dst is this context rather than the
+// bare dasm_State, so the templates read their options from it instead of
+// from globals and independent compilations can run concurrently.
+typedef struct bf_jit {
+    struct dasm_State *D;       // DynASM encoder state (Dst_REF)
+    bool unsafe_mode;           // No tape masking; guard pages catch overruns
+    bf_eof_mode_t eof_mode;     // EOF convention for ','
+    size_t memory_mask;         // Safe mode address mask, tape size - 1
+    bool block_direct;          // Compiling the unmasked copy of a range-checked block
+    bool count_mode;            // Code bumps counters stored after the bf_io_t
+    bool fragment;              // Compiling one loop as a bf_fragment_func
+    bf_lazy_t *lazy;            // Large loops become stubs, NULL to compile everything
+    ast_node_t *lazy_root;      // The loop a lazy fragment is compiled for, never a stub itself
+    bf_peep_t peep;             // Peephole state at the current point
+    bf_peep_t block_peep;       // Peephole state at the fast copy's jump to the block end
+    const bf_pgo_t *pgo;        // Profile guiding code layout, NULL without one
+    bf_counters_t *counters;    // Counter slots being assigned, NULL when not counting
+    cold_loop_t *cold_loops;
+    int cold_loop_count;
+    int cold_loop_capacity;
+    bool cold_code;             // Emitting out-of-line code: cold loops, or the cold section
+} bf_jit_t;
+
+static void peep_reset(bf_jit_t *Dst) {
+    Dst->peep = (bf_peep_t){ 0 };
+}
+
+// State at a label, from the states on its incoming edges
+static bf_peep_t peep_meet(bf_peep_t a, bf_peep_t b) {
+    bf_peep_t meet = { 0 };
+    if (a.cell_tested && b.cell_tested && a.cell_reg == b.cell_reg) {
+        meet.cell_tested = true;
+        meet.cell_reg = a.cell_reg;
+    }
+    if (a.index_valid && b.index_valid && a.index_offset == b.index_offset) {
+        meet.index_valid = true;
+        meet.index_offset = a.index_offset;
+    }
+    return meet;
+}
+
+// Vector run: a run of SET_CONST, ADD_VAL or same-source MUL nodes as the
+// cells it touches (sorted, distinct) and the byte each one stores, adds or
+// multiplies by. The architecture files cover its dense windows with wide
+// loads and stores; only compiled where cells need no masking.
+typedef struct {
+    int *offsets;
+    unsigned char *values;
+    int count;
+} bf_run_t;
+
+#define BF_RUN_MIN_NODES 2          // Shorter runs gain nothing from merging
+
+// Lanes of the width-cell window starting at run entry k, zero where the
+// run has no cell. Returns the entries it covers, or 0 when that is fewer
+// than min or the window reaches past the run's last cell (which may be
+// the edge of a range-checked block).
+static int run_window(const bf_run_t *run, int k, int width, int min, unsigned char *lanes) {
+    int start = run->offsets[k];
+    if (start + width - 1 > run->offsets[run->count - 1]) return 0;
+
+    int n = 0;
+    memset(lanes, 0, (size_t)width);
+    while (k + n < run->count && run->offsets[k + n] < start + width) {
+        lanes[run->offsets[k + n] - start] = run->values[k + n];
+        n++;
+    }
+    return n >= min ? n : 0;
+}
+
+#define Dst_DECL bf_jit_t *Dst
+#define Dst_REF (Dst->D)
+#include "dasm_proto.h"
+
+// Memory allocation with guard pages
+char *allocate_guarded_memory(size_t size) {
+    // Get page size for alignment
+    size_t page_size = getpagesize();
+
+    // Round up size to page boundary
+    size_t aligned_size = (size + page_size - 1) & ~(page_size - 1);
+
+    // Allocate 3 regions: guard page + data + guard page
+    size_t total_size = page_size + aligned_size + page_size;
+
+    void *region = mmap(NULL, total_size, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (region == MAP_FAILED) {
+        return NULL;
+    }
+
+    char *guard1 = (char*)region;
+    char *data = guard1 + page_size;
+    char *guard2 = data + aligned_size;
+
+    // Make guard pages inaccessible (no read/write/execute)
+    if (mprotect(guard1, page_size, PROT_NONE) != 0 ||
+        mprotect(guard2, page_size, PROT_NONE) != 0) {
+        munmap(region, total_size);
+        return NULL;
+    }
+
+    return data;
+}
+
+// Safe mode wraps with (offset & mask), which is only a clean modulo when the
+// tape size is a power of two. Otherwise cells alias (e.g. a mask of 0xEFFF
+// maps cell 0x1000 onto cell 0), so round the usable size down instead.
+size_t tape_size_pow2(size_t size) {
+    size_t pow2 = 1;
+    while (pow2 <= size / 2) {
+        pow2 *= 2;
+    }
+    return pow2;
+}
+
+void free_guarded_memory(char *memory, size_t size) {
+    if (!memory) return;
+
+    size_t page_size = getpagesize();
+    size_t aligned_size = (size + page_size - 1) & ~(page_size - 1);
+    size_t total_size = page_size + aligned_size + page_size;
+
+    // Find start of the full region (guard page before data)
+    char *region_start = memory - page_size;
+    munmap(region_start, total_size);
+}
+
+// Include architecture-specific generated C files based on target architecture
+#if defined(__x86_64__) || defined(__x86_64) || defined(__amd64__) || defined(__amd64)
+#include "dasm_x86.h"
+#include "bf_amd64.c"
+#elif defined(__aarch64__) || defined(__arm64__)
+#include "dasm_arm64.h"
+#include "bf_arm64.c"
+#else
+#error "Unsupported architecture"
+#endif
+
+// FNV-1a over the DynASM action list: any change to the templates changes
+// the id, and builds of the same templates share cache entries. Changes in
+// the C code that emit different code from the same templates must bump
+// BF_CACHE_VERSION instead.
+uint64_t bf_codegen_id(void) {
+    const unsigned char *p = (const unsigned char *)actions;
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < sizeof(actions); i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static void dump_code_hex(void *code, size_t size) {
+    fprintf(stderr, "\nDumping %zu bytes of compiled machine code:\n", size);
+    unsigned char *bytes = (unsigned char *)code;
+    for (size_t i = 0; i < size; i++) {
+        if (i % 16 == 0) fprintf(stderr, "%08zx: ", i);
+        fprintf(stderr, "%02x ", bytes[i]);
+        if (i % 16 == 15) fprintf(stderr, "\n");
+    }
+    if (size % 16 != 0) fprintf(stderr, "\n");
+    fprintf(stderr, "\n");
+}
+
+static int ast_compile_direct(ast_node_t *node, bf_jit_t *Dst, int next_label, bf_debug_info_t *debug, int *debug_label, bool debug_mode);
+
+// Loops and scans branch and move the pointer by a data-dependent amount;
+// everything else belongs to a straight-line block
+static bool is_straight_line(ast_node_t *node) {
+    return node->type != AST_LOOP && node->type != AST_IF && node->type != AST_SCAN;
+}
+
+// Find the end of the straight-line block starting at node and the range
+// of cell offsets it touches, relative to the pointer at block entry
+static ast_node_t *block_range(ast_node_t *node, long *lo, long *hi, int *accesses) {
+    long delta = 0;
+    *lo = 0;
+    *hi = 0;
+    *accesses = 0;
+
+    for (; node && is_straight_line(node); node = node->next) {
+        long first, second, third;
+        int n = 0;
+
+        switch (node->type) {
+            case AST_MOVE_PTR:
+                delta += node->data.basic.count;
+                break;
+            case AST_ADD_VAL:
+            case AST_SET_CONST:
+            case AST_INPUT:
+            case AST_OUTPUT:
+                first = delta + node->data.basic.offset;
+                n = 1;
+                break;
+            case AST_MUL:
+                first = delta + node->data.mul.src_offset;
+                second = delta + node->data.mul.dst_offset;
+                n = 2;
+                break;
+            case AST_MUL2:
+                first = delta + node->data.mul.src_offset;
+                second = delta + node->data.mul.dst_offset;
+                third = delta + node->data.mul.src2_offset;
+                n = 3;
+                break;
+            default:
+                break;
+        }
+
+        for (int i = 0; i < n; i++) {
+            long ofs = i == 0 ? first : i == 1 ? second : third;
+            if (*accesses == 0 && i == 0) {
+                *lo = *hi = ofs;
+            }
+            if (ofs < *lo) *lo = ofs;
+            if (ofs > *hi) *hi = ofs;
+        }
+        *accesses += n;
+    }
+
+    return node;
+}
+
+static void ast_compile_debug_label(ast_node_t *node, bf_jit_t *Dst, bf_debug_info_t *debug, int *debug_label) {
+    if (debug && debug_label) {
+        int current_debug_label = (*debug_label)++;
+        bf_debug_add_mapping(debug, current_debug_label, node, node->line, node->column);
+        compile_bf_debug_label(Dst, current_debug_label);
+    }
+}
+
+static void ast_compile_count(ast_node_t *node, bf_jit_t *Dst, bf_count_kind_t kind) {
+    if (Dst->counters) {
+        compile_bf_count(Dst, bf_counters_add(Dst->counters, node, kind));
+    }
+}
+
+// --count=nodes: every node other than a loop counts its runs on entry
+static void ast_compile_run_count(ast_node_t *node, bf_jit_t *Dst) {
+    if (Dst->counters && Dst->counters->nodes && node->type != AST_LOOP && node->type != AST_IF) {
+        ast_compile_count(node, Dst, BF_COUNT_RUNS);
+    }
+}
+
+// Bind a label reached by falling through and by branches that left the
+// peephole state taken: only what both paths agree on survives
+static void compile_bf_join(bf_jit_t *Dst, int label, bf_peep_t taken) {
+    bf_peep_t here = Dst->peep;
+    compile_bf_label(Dst, label);
+    Dst->peep = peep_meet(here, taken);
+}
+
+static void defer_cold_loop(bf_jit_t *Dst, ast_node_t *node, int start_label, int end_label) {
+    if (Dst->cold_loop_count == Dst->cold_loop_capacity) {
+        Dst->cold_loop_capacity = Dst->cold_loop_capacity ? Dst->cold_loop_capacity * 2 : 16;
+        Dst->cold_loops = realloc(Dst->cold_loops, (size_t)Dst->cold_loop_capacity * sizeof(cold_loop_t));
+        if (!Dst->cold_loops) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    Dst->cold_loops[Dst->cold_loop_count++] = (cold_loop_t){ node, start_label, end_label };
+}
+
+// First entry of a lazy loop: compile its body, repoint the slot and run
+// it. Other threads entering meanwhile wait for the same compilation
+// rather than starting their own.
+static long lazy_resolve(char *memory, bf_io_t *io, long offset, lazy_slot_t *slot) {
+    bf_lazy_t *lazy = slot->lazy;
+
+    pthread_mutex_lock(&lazy->lock);
+    if (!slot->code) {
+        if (!bf_codegen_compile(slot->node, &lazy->options, &slot->code, &slot->code_size)) {
+            fprintf(stderr, "Error: Could not compile loop at line %d, column %d\n", slot->node->line, slot->node->column);
+            exit(1);
+        }
+        __atomic_store_n(&slot->entry, (lazy_entry_t)slot->code, __ATOMIC_RELEASE);
+    }
+    pthread_mutex_unlock(&lazy->lock);
+
+    return ((bf_fragment_func)slot->code)(memory, io, offset);
+}
+
+// Called before the code runs, or by lazy_resolve with the lock held
+static lazy_slot_t *lazy_add_slot(bf_lazy_t *lazy, ast_node_t *node) {
+    lazy_slot_t *slot = calloc(1, sizeof(lazy_slot_t));
+    if (!slot) {
+        perror("calloc");
+        exit(1);
+    }
+    slot->entry = lazy_resolve;
+    slot->node = node;
+    slot->lazy = lazy;
+    slot->next = lazy->slots;
+    lazy->slots = slot;
+    lazy->stub_count++;
+    return slot;
+}
+
+// Nodes in the list at node, counting at most up to limit
+static int count_nodes_upto(ast_node_t *node, int limit) {
+    int count = 0;
+    for (; node && count < limit; node = node->next) {
+        count++;
+        if (ast_has_body(node)) {
+            count += count_nodes_upto(node->data.loop.body, limit - count);
+        }
+    }
+    return count;
+}
+
+// Large bodies are left for first entry, except the loop a fragment is
+// being compiled for and loops the profile found hot
+static bool is_lazy(bf_jit_t *Dst, ast_node_t *node) {
+    return Dst->lazy && node != Dst->lazy_root && !bf_pgo_hot(Dst->pgo, node) &&
+           count_nodes_upto(node->data.loop.body, BF_LAZY_MIN_NODES) >= BF_LAZY_MIN_NODES;
+}
+
+// Stub for a loop or IF: test the cell here, so skipped bodies cost no
+// call, and run the body through its slot. Returns next_label past the
+// labels the body would have used.
+static int ast_compile_lazy(ast_node_t *node, bf_jit_t *Dst, int end_label, int next_label) {
+    compile_bf_loop_start(Dst, end_label);
+    bf_peep_t skipped = Dst->peep;
+    compile_bf_lazy_call(Dst, lazy_add_slot(Dst->lazy, node));
+    compile_bf_join(Dst, end_label, skipped);
+    ast_node_t *body = node->data.loop.body;
+    return next_label + ast_count_loops(body) * 2 + ast_count_ifs(body);
+}
+
+static bool has_inner_loop(ast_node_t *node) {
+    for (; node; node = node->next) {
+        if (node->type == AST_LOOP) return true;
+        if (ast_has_body(node) && has_inner_loop(node->data.loop.body)) return true;
+    }
+    return false;
+}
+
+// Loop heads that start a fetch block: the ones a profile found hot, and
+// for loops it has no counts for, innermost loops, where the iterations
+// are. The padding runs once per entry; out-of-line cold code skips it.
+static bool align_loop_head(bf_jit_t *Dst, ast_node_t *node) {
+    if (Dst->cold_code) return false;
+    if (Dst->pgo && node->profiled) return bf_pgo_hot(Dst->pgo, node);
+    return !has_inner_loop(node->data.loop.body);
+}
+
+static int ast_compile_node(ast_node_t *node, bf_jit_t *Dst, int next_label, bf_debug_info_t *debug, int *debug_label, bool debug_mode) {
+    ast_compile_debug_label(node, Dst, debug, debug_label);
+    ast_compile_run_count(node, Dst);
+
+    switch (node->type) {
+        case AST_MOVE_PTR:
+            compile_bf_move_ptr(Dst, node->data.basic.count);
+            break;
+
+        case AST_ADD_VAL:
+            compile_bf_add_val(Dst, node->data.basic.count, node->data.basic.offset);
+            break;
+
+        case AST_OUTPUT:
+            compile_bf_output(Dst, node->data.basic.offset);
+            break;
+
+        case AST_INPUT:
+            compile_bf_input(Dst, node->data.basic.offset);
+            break;
+
+        case AST_LOOP: {
+            int start_label = next_label++;
+            int end_label = next_label++;
+            ast_compile_count(node, Dst, BF_COUNT_ENTRIES);
+            if (is_lazy(Dst, node)) {
+                next_label = ast_compile_lazy(node, Dst, end_label, next_label);
+                break;
+            }
+            if (bf_pgo_cold(Dst->pgo, node)) {
+                // Branch out to the rotated loop; it jumps back to end_label
+                compile_bf_loop_end(Dst, start_label);
+                compile_bf_label(Dst, end_label);
+                defer_cold_loop(Dst, node, start_label, end_label);
+                break;
+            }
+            compile_bf_loop_start(Dst, end_label);
+            bf_peep_t skipped = Dst->peep;
+            if (align_loop_head(Dst, node)) compile_bf_align_loop(Dst);
+            compile_bf_label(Dst, start_label);
+            ast_compile_count(node, Dst, BF_COUNT_ITERATIONS);
+            next_label = ast_compile_direct(node->data.loop.body, Dst, next_label, debug, debug_label, debug_mode);
+            compile_bf_loop_end(Dst, start_label);
+            // Both ways out have just tested the cell, so a test right
+            // after the loop (as in "]]" or "][") is dropped
+            compile_bf_join(Dst, end_label, skipped);
+            break;
+        }
+
+        case AST_IF: {
+            // Guard branch only: the body leaves the cell zero, so there
+            // is no back-edge
+            int end_label = next_label++;
+            ast_compile_count(node, Dst, BF_COUNT_ENTRIES);
+            if (is_lazy(Dst, node)) {
+                next_label = ast_compile_lazy(node, Dst, end_label, next_label);
+                break;
+            }
+            compile_bf_loop_start(Dst, end_label);
+            bf_peep_t skipped = Dst->peep;
+            ast_compile_count(node, Dst, BF_COUNT_ITERATIONS);
+            next_label = ast_compile_direct(node->data.loop.body, Dst, next_label, debug, debug_label, debug_mode);
+            compile_bf_join(Dst, end_label, skipped);
+            break;
+        }
+
+
+        case AST_SET_CONST:
+            compile_bf_set_const(Dst, node->data.basic.count, node->data.basic.offset);
+            break;
+
+        case AST_MUL:
+            compile_bf_mul(Dst, node->data.mul.multiplier, node->data.mul.src_offset, node->data.mul.dst_offset);
+            break;
+
+        case AST_MUL2:
+            compile_bf_mul2(Dst, node->data.mul.multiplier, node->data.mul.src_offset, node->data.mul.src2_offset, node->data.mul.dst_offset);
+            break;
+
+        case AST_SCAN:
+            compile_bf_scan(Dst, node->data.basic.count);
+            break;
+
+        case AST_DEBUG_LOG:
+            compile_bf_debug_log(Dst, debug_mode, node->line, node->column);
+            break;
+    }
+
+    return next_label;
+}
+
+// Block-local cell cache. A segment is a straight-line run up to the next
+// node that calls out (I/O, debug log). Its most-accessed cells live in
+// BF_CACHE_REGS scratch registers: each is loaded at most once, stores are
+// forwarded to later reads, and dirty cells are written back once when the
+// segment ends.
+typedef struct {
+    long key;       // Cell offset relative to the pointer at segment entry
+    bool loaded;    // Register holds the current cell value
+    bool dirty;     // Register value not yet written back
+} cache_slot_t;
+
+typedef struct {
+    cache_slot_t slot[BF_CACHE_REGS];
+    int slots;
+    long delta;     // Pointer movement since segment entry
+} cell_cache_t;
+
+static bool calls_out(ast_node_t *node) {
+    return node->type == AST_INPUT || node->type == AST_OUTPUT || node->type == AST_DEBUG_LOG;
+}
+
+// One cell access in a segment, with the samples its node collected in a
+// --pgo-in profile
+typedef struct {
+    long key;
+    int samples;
+} cache_use_t;
+
+static int compare_use(const void *a, const void *b) {
+    long x = ((const cache_use_t *)a)->key;
+    long y = ((const cache_use_t *)b)->key;
+    return (x > y) - (x < y);
+}
+
+// Cache the cells of [node, end) that are accessed at least twice, most
+// accessed first. With a profile, ties go to the cells whose nodes took
+// the most samples. Slots are keyed on the offset, so in safe mode a
+// segment whose offsets span more than the masked tape caches nothing:
+// two keys could name the same cell.
+static void cache_plan(cell_cache_t *cache, const bf_jit_t *Dst, ast_node_t *node, ast_node_t *end) {
+    int counts[BF_CACHE_REGS];
+    long weights[BF_CACHE_REGS];
+    size_t n = 0, capacity = 0;
+    cache_use_t *uses = NULL;
+    long delta = 0;
+
+    cache->slots = 0;
+    cache->delta = 0;
+
+    for (; node != end; node = node->next) {
+        if (capacity < n + 3) {
+            capacity = capacity ? capacity * 2 : 64;
+            uses = realloc(uses, capacity * sizeof(cache_use_t));
+            if (!uses) {
+                perror("realloc");
+                exit(1);
+            }
+        }
+        int samples = node->profile_samples;
+        switch (node->type) {
+            case AST_MOVE_PTR:
+                delta += node->data.basic.count;
+                break;
+            case AST_ADD_VAL:
+            case AST_SET_CONST:
+                uses[n++] = (cache_use_t){ delta + node->data.basic.offset, samples };
+                break;
+            case AST_MUL:
+                if (node->data.mul.multiplier != 0) {
+                    uses[n++] = (cache_use_t){ delta + node->data.mul.src_offset, samples };
+                    uses[n++] = (cache_use_t){ delta + node->data.mul.dst_offset, samples };
+                }
+                break;
+            case AST_MUL2:
+                if (node->data.mul.multiplier != 0) {
+                    uses[n++] = (cache_use_t){ delta + node->data.mul.src_offset, samples };
+                    uses[n++] = (cache_use_t){ delta + node->data.mul.src2_offset, samples };
+                    uses[n++] = (cache_use_t){ delta + node->data.mul.dst_offset, samples };
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    qsort(uses, n, sizeof(cache_use_t), compare_use);
+    if (n > 0 && !Dst->unsafe_mode && (unsigned long)(uses[n - 1].key - uses[0].key) > Dst->memory_mask) n = 0;
+
+    for (size_t i = 0; i < n;) {
+        size_t j = i;
+        long weight = 0;
+        while (j < n && uses[j].key == uses[i].key) weight += uses[j++].samples;
+        int count = (int)(j - i);
+
+        if (count >= 2) {
+            // Insertion into the top BF_CACHE_REGS by access count, then weight
+            int pos = cache->slots;
+            while (pos > 0 && (counts[pos - 1] < count ||
+                               (counts[pos - 1] == count && weights[pos - 1] < weight))) pos--;
+            if (pos < BF_CACHE_REGS) {
+                int last = cache->slots < BF_CACHE_REGS ? cache->slots : BF_CACHE_REGS - 1;
+                for (int k = last; k > pos; k--) {
+                    cache->slot[k] = cache->slot[k - 1];
+                    counts[k] = counts[k - 1];
+                    weights[k] = weights[k - 1];
+                }
+                cache->slot[pos] = (cache_slot_t){ .key = uses[i].key, .loaded = false, .dirty = false };
+                counts[pos] = count;
+                weights[pos] = weight;
+                if (cache->slots < BF_CACHE_REGS) cache->slots++;
+            }
+        }
+        i = j;
+    }
+
+    free(uses);
+}
+
+static int cache_lookup(cell_cache_t *cache, int offset) {
+    long key = cache->delta + offset;
+    for (int i = 0; i < cache->slots; i++) {
+        if (cache->slot[i].key == key) return i;
+    }
+    return -1;
+}
+
+// Register holding the cell at offset, loading it on first use; -1 when
+// the cell is not cached
+static int cache_value(cell_cache_t *cache, bf_jit_t *Dst, int offset) {
+    int i = cache_lookup(cache, offset);
+    if (i < 0) return -1;
+    if (!cache->slot[i].loaded) {
+        compile_bf_cell_load(Dst, bf_cache_reg(i), offset);
+        cache->slot[i].loaded = true;
+    }
+    return bf_cache_reg(i);
+}
+
+static void cache_write_back(cell_cache_t *cache, bf_jit_t *Dst) {
+    for (int i = 0; i < cache->slots; i++) {
+        if (cache->slot[i].dirty) {
+            compile_bf_cell_store(Dst, bf_cache_reg(i), (int)(cache->slot[i].key - cache->delta));
+        }
+    }
+}
+
+// Whether node continues a vector run of the same kind as first
+static bool run_continues(ast_node_t *first, ast_node_t *node) {
+    if (node->type != first->type) return false;
+    if (node->type != AST_MUL) return true;
+    return node->data.mul.src_offset == first->data.mul.src_offset &&
+           node->data.mul.dst_offset != node->data.mul.src_offset;
+}
+
+typedef struct {
+    int offset;
+    int order;
+    int value;
+} run_entry_t;
+
+static int compare_run_entry(const void *a, const void *b) {
+    const run_entry_t *x = a, *y = b;
+    if (x->offset != y->offset) return (x->offset > y->offset) - (x->offset < y->offset);
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+// Compile the run of at least BF_RUN_MIN_NODES mergeable nodes at node as
+// one vector run and return its last node, or return NULL to leave the
+// nodes to the cell cache. Stores to one cell keep the last, adds and
+// multipliers sum.
+static ast_node_t *ast_compile_run(cell_cache_t *cache, ast_node_t *node, ast_node_t *end, bf_jit_t *Dst, bf_debug_info_t *debug, int *debug_label) {
+    if (!Dst->unsafe_mode && !Dst->block_direct) return NULL;
+    if (node->type != AST_SET_CONST && node->type != AST_ADD_VAL && node->type != AST_MUL) return NULL;
+    if (node->type == AST_MUL && node->data.mul.dst_offset == node->data.mul.src_offset) return NULL;
+
+    int count = 0;
+    ast_node_t *last = node;
+    for (ast_node_t *n = node; n != end && run_continues(node, n); n = n->next) {
+        last = n;
+        count++;
+    }
+    if (count < BF_RUN_MIN_NODES) return NULL;
+
+    run_entry_t *entries = malloc((size_t)count * sizeof(run_entry_t));
+    int *offsets = malloc((size_t)count * sizeof(int));
+    unsigned char *values = malloc((size_t)count);
+    if (!entries || !offsets || !values) {
+        perror("malloc");
+        exit(1);
+    }
+    ast_node_t *n = node;
+    for (int i = 0; i < count; i++, n = n->next) {
+        if (n->type == AST_MUL) {
+            entries[i] = (run_entry_t){ n->data.mul.dst_offset, i, n->data.mul.multiplier };
+        } else {
+            entries[i] = (run_entry_t){ n->data.basic.offset, i, n->data.basic.count };
+        }
+    }
+    qsort(entries, (size_t)count, sizeof(run_entry_t), compare_run_entry);
+
+    bf_run_t run = { offsets, values, 0 };
+    for (int i = 0; i < count; i++) {
+        if (run.count > 0 && offsets[run.count - 1] == entries[i].offset) {
+            int merged = node->type == AST_SET_CONST ? entries[i].value : values[run.count - 1] + entries[i].value;
+            values[run.count - 1] = (unsigned char)merged;
+            continue;
+        }
+        offsets[run.count] = entries[i].offset;
+        values[run.count] = (unsigned char)entries[i].value;
+        run.count++;
+    }
+    free(entries);
+
+    // Every cell between the first and last is loaded and stored back, so
+    // none of them may live in a register
+    int lo = offsets[0], hi = offsets[run.count - 1];
+    if (node->type == AST_MUL) {
+        int src = node->data.mul.src_offset;
+        if (src < lo) lo = src;
+        if (src > hi) hi = src;
+    }
+    bool cached = false;
+    for (int i = 0; i < cache->slots; i++) {
+        long key = cache->slot[i].key - cache->delta;
+        if (key >= lo && key <= hi) cached = true;
+    }
+
+    if (!cached) {
+        for (n = node; n != last->next; n = n->next) {
+            ast_compile_debug_label(n, Dst, debug, debug_label);
+            ast_compile_run_count(n, Dst);
+        }
+        if (node->type == AST_SET_CONST) {
+            compile_bf_store_run(Dst, &run);
+        } else if (node->type == AST_ADD_VAL) {
+            compile_bf_add_run(Dst, &run);
+        } else {
+            compile_bf_mul_run(Dst, node->data.mul.src_offset, &run);
+        }
+    }
+    free(offsets);
+    free(values);
+    return cached ? NULL : last;
+}
+
+static void ast_compile_segment(ast_node_t *node, ast_node_t *end, bf_jit_t *Dst, bf_debug_info_t *debug, int *debug_label) {
+    cell_cache_t cache;
+    cache_plan(&cache, Dst, node, end);
+
+    for (; node != end; node = node->next) {
+        int i, reg;
+        ast_node_t *run_last = ast_compile_run(&cache, node, end, Dst, debug, debug_label);
+        if (run_last) {
+            node = run_last;
+            continue;
+        }
+        ast_compile_debug_label(node, Dst, debug, debug_label);
+        ast_compile_run_count(node, Dst);
+
+        switch (node->type) {
+            case AST_MOVE_PTR:
+                compile_bf_move_ptr(Dst, node->data.basic.count);
+                cache.delta += node->data.basic.count;
+                break;
+
+            case AST_ADD_VAL:
+                reg = cache_value(&cache, Dst, node->data.basic.offset);
+                if (reg < 0) {
+                    compile_bf_add_val(Dst, node->data.basic.count, node->data.basic.offset);
+                    break;
+                }
+                compile_bf_reg_add(Dst, reg, node->data.basic.count);
+                cache.slot[cache_lookup(&cache, node->data.basic.offset)].dirty = true;
+                break;
+
+            case AST_SET_CONST:
+                i = cache_lookup(&cache, node->data.basic.offset);
+                if (i < 0) {
+                    compile_bf_set_const(Dst, node->data.basic.count, node->data.basic.offset);
+                    break;
+                }
+                compile_bf_reg_set(Dst, bf_cache_reg(i), node->data.basic.count);
+                cache.slot[i].loaded = true;
+                cache.slot[i].dirty = true;
+                break;
+
+            case AST_MUL: {
+                int src_reg, dst_reg;
+                if (node->data.mul.multiplier == 0) break;
+                src_reg = cache_value(&cache, Dst, node->data.mul.src_offset);
+                dst_reg = cache_value(&cache, Dst, node->data.mul.dst_offset);
+                if (src_reg < 0 && dst_reg < 0) {
+                    compile_bf_mul(Dst, node->data.mul.multiplier, node->data.mul.src_offset, node->data.mul.dst_offset);
+                    break;
+                }
+                compile_bf_reg_mul(Dst, node->data.mul.multiplier, src_reg, node->data.mul.src_offset, dst_reg, node->data.mul.dst_offset);
+                if (dst_reg >= 0) {
+                    cache.slot[cache_lookup(&cache, node->data.mul.dst_offset)].dirty = true;
+                }
+                break;
+            }
+
+            case AST_MUL2: {
+                int src_reg, src2_reg, dst_reg;
+                if (node->data.mul.multiplier == 0) break;
+                src_reg = cache_value(&cache, Dst, node->data.mul.src_offset);
+                src2_reg = cache_value(&cache, Dst, node->data.mul.src2_offset);
+                dst_reg = cache_value(&cache, Dst, node->data.mul.dst_offset);
+                compile_bf_reg_mul2(Dst, node->data.mul.multiplier, src_reg, node->data.mul.src_offset,
+                                    src2_reg, node->data.mul.src2_offset, dst_reg, node->data.mul.dst_offset);
+                if (dst_reg >= 0) {
+                    cache.slot[cache_lookup(&cache, node->data.mul.dst_offset)].dirty = true;
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+
+    cache_write_back(&cache, Dst);
+}
+
+// Compile [node, end) of a straight-line block, splitting it into cached
+// segments at nodes that call out
+static void ast_compile_straight_line(ast_node_t *node, ast_node_t *end, bf_jit_t *Dst, bf_debug_info_t *debug, int *debug_label, bool debug_mode) {
+    while (node != end) {
+        if (calls_out(node)) {
+            ast_compile_node(node, Dst, 0, debug, debug_label, debug_mode);
+            node = node->next;
+            continue;
+        }
+        ast_node_t *segment_end = node;
+        while (segment_end != end && !calls_out(segment_end)) segment_end = segment_end->next;
+        ast_compile_segment(node, segment_end, Dst, debug, debug_label);
+        node = segment_end;
+    }
+}
+
+static int ast_compile_direct(ast_node_t *node, bf_jit_t *Dst, int next_label, bf_debug_info_t *debug, int *debug_label, bool debug_mode) {
+    while (node) {
+        if (!is_straight_line(node)) {
+            next_label = ast_compile_node(node, Dst, next_label, debug, debug_label, debug_mode);
+            node = node->next;
+            continue;
+        }
+
+        // Safe mode: check the block's offset range once, then run an
+        // unmasked copy; the masked copy only runs near the wrap
+        long lo, hi;
+        int accesses;
+        ast_node_t *block_end = block_range(node, &lo, &hi, &accesses);
+        // Cold code is not worth doubling in size. The guard only proves the
+        // block stays inside the tape when every offset is within one tape
+        // size of the cell; anything further out keeps the masked copy.
+        bool in_range = lo >= INT_MIN && hi <= INT_MAX &&
+                        (hi <= 0 || (unsigned long)hi <= Dst->memory_mask) &&
+                        (lo >= 0 || (unsigned long)-lo <= Dst->memory_mask) &&
+                        (unsigned long)(hi - lo) <= Dst->memory_mask;
+        bool hoist = !Dst->unsafe_mode && !Dst->cold_code && accesses >= 2 && in_range;
+
+        if (hoist) {
+            compile_bf_block_guard(Dst, (int)lo, (int)hi);
+            Dst->block_direct = true;
+        }
+        ast_compile_straight_line(node, block_end, Dst, debug, debug_label, debug_mode);
+        if (hoist) {
+            Dst->block_direct = false;
+            compile_bf_block_slow(Dst);
+            ast_compile_straight_line(node, block_end, Dst, NULL, NULL, debug_mode);
+            compile_bf_block_end(Dst);
+        }
+        node = block_end;
+    }
+
+    return next_label;
+}
+
+// One shared memory object mapped twice, writable and executable, handed
+// out in whole pages by a lock-free bump pointer. Blocks live until the
+// arena is freed.
+struct bf_code_arena {
+    unsigned char *rw;
+    unsigned char *rx;
+    size_t size;
+    size_t used;
+};
+
+bf_code_arena_t *bf_code_arena_create(size_t size) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    size_t page_size = (size_t)getpagesize();
+    size = (size + page_size - 1) & ~(page_size - 1);
+
+    int fd = memfd_create("bf-code", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+    void *rw = MAP_FAILED, *rx = MAP_FAILED;
+    if (ftruncate(fd, (off_t)size) == 0) {
+        rw = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        rx = mmap(NULL, size, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    }
+    int saved = errno;
+    close(fd);
+    if (rw == MAP_FAILED || rx == MAP_FAILED) {
+        if (rw != MAP_FAILED) munmap(rw, size);
+        if (rx != MAP_FAILED) munmap(rx, size);
+        errno = saved;
+        return NULL;
+    }
+
+    bf_code_arena_t *arena = calloc(1, sizeof(bf_code_arena_t));
+    if (!arena) {
+        perror("calloc");
+        exit(1);
+    }
+    arena->rw = rw;
+    arena->rx = rx;
+    arena->size = size;
+    return arena;
+#else
+    // Without memfd_create there is no anonymous object to map twice
+    (void)size;
+    errno = ENOSYS;
+    return NULL;
+#endif
+}
+
+// Executable address of a block of at least size bytes, its writable
+// alias in *rw; NULL once the arena is full
+static void *code_arena_alloc(bf_code_arena_t *arena, size_t size, unsigned char **rw) {
+    size_t page_size = (size_t)getpagesize();
+    size_t want = (size + page_size - 1) & ~(page_size - 1);
+    size_t at = __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+    do {
+        if (want > arena->size - at) return NULL;
+    } while (!__atomic_compare_exchange_n(&arena->used, &at, at + want, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+    *rw = arena->rw + at;
+    return arena->rx + at;
+}
+
+bool bf_code_arena_owns(const bf_code_arena_t *arena, const void *code) {
+    const unsigned char *p = code;
+    return arena && p >= arena->rx && p < arena->rx + arena->size;
+}
+
+size_t bf_code_arena_used(const bf_code_arena_t *arena) {
+    return __atomic_load_n(&arena->used, __ATOMIC_RELAXED);
+}
+
+void bf_code_arena_free(bf_code_arena_t *arena) {
+    if (!arena) return;
+    munmap(arena->rw, arena->size);
+    munmap(arena->rx, arena->size);
+    free(arena);
+}
+
+static void codegen_error(const char *msg) {
+    fprintf(stderr, "Error: %s\n", msg);
+}
+
+bf_func bf_codegen_compile(ast_node_t *ast, const bf_codegen_options_t *options, void **code_ptr, size_t *code_size) {
+    bf_debug_info_t *debug_info = options->debug_info;
+    bool debug_mode = options->debug_mode;
+
+    bf_jit_t jit = {
+        .unsafe_mode = options->unsafe_mode,
+        .eof_mode = options->eof_mode,
+        .memory_mask = options->memory_size - 1,
+        .count_mode = options->counters != NULL,
+        .fragment = options->fragment,
+        .lazy = options->lazy,
+        .pgo = options->pgo,
+        .counters = options->counters,
+    };
+    bf_jit_t *Dst = &jit;
+
+    // A fragment is the loop alone, without the nodes after it
+    ast_node_t fragment;
+    if (options->fragment) {
+        fragment = *ast;
+        fragment.next = NULL;
+        ast = &fragment;
+        jit.lazy_root = ast;
+    }
+
+    dasm_init(Dst, DASM_MAXSECTION);
+    dasm_setup(Dst, actions);
+
+    // Two PC labels per loop, one per IF, then one per node for the debug
+    // map and two marking where the epilogue and the cold section start
+    int loop_label_count = ast_count_loops(ast) * 2 + ast_count_ifs(ast);
+    int debug_label_count = debug_info ? ast_count_nodes(ast) : 0;
+    int exit_label = loop_label_count + debug_label_count;
+    int cold_label = exit_label + 1;
+    dasm_growpc(Dst, loop_label_count + debug_label_count + (debug_info ? 2 : 0));
+    if (debug_info) compile_bf_cold_label(Dst, cold_label);
+
+    compile_bf_prologue(Dst, options->memory_size);
+
+    // State left by the partially evaluated prefix; ast is what remains
+    const bf_peval_t *prelude = options->prelude;
+    if (prelude) {
+        compile_bf_image(Dst, prelude->image, prelude->image_start, prelude->image_size);
+        compile_bf_output_bytes(Dst, prelude->output, prelude->output_size);
+    }
+
+    int debug_label_counter = loop_label_count; // Start debug labels after loop labels
+    int used_loop_labels = ast_compile_direct(ast, Dst, 0, debug_info, debug_info ? &debug_label_counter : NULL, debug_mode);
+
+    if (debug_info) compile_bf_debug_label(Dst, exit_label);
+    compile_bf_epilogue(Dst);
+
+    // Out-of-line cold loops, which may defer further loops of their own
+    jit.cold_code = true;
+    for (int i = 0; i < jit.cold_loop_count; i++) {
+        cold_loop_t cold = jit.cold_loops[i];
+        compile_bf_label(Dst, cold.start_label);
+        ast_compile_count(cold.node, Dst, BF_COUNT_ITERATIONS);
+        used_loop_labels = ast_compile_direct(cold.node->data.loop.body, Dst, used_loop_labels, debug_info, debug_info ? &debug_label_counter : NULL, debug_mode);
+        compile_bf_loop_end(Dst, cold.start_label);
+        compile_bf_jump(Dst, cold.end_label);
+    }
+    free(jit.cold_loops);
+
+    void *code = MAP_FAILED;
+    unsigned char *encode_at = NULL;    // Writable view of code
+    bool in_arena = false;
+    size_t size = 0;
+    if (used_loop_labels != loop_label_count || debug_label_counter > loop_label_count + debug_label_count) {
+        codegen_error("PC label count mismatch");
+        goto fail;
+    }
+
+    if (dasm_link(Dst, &size) != 0) {
+        codegen_error("DynASM linking failed");
+        goto fail;
+    }
+
+    // An arena block is already executable; a full arena falls back to a
+    // mapping of its own
+    if (options->arena) {
+        void *block = code_arena_alloc(options->arena, size, &encode_at);
+        if (block) {
+            code = block;
+            in_arena = true;
+        }
+    }
+    if (!in_arena) {
+        code = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (code == MAP_FAILED) {
+            codegen_error("Memory mapping failed");
+            goto fail;
+        }
+        encode_at = code;
+    }
+
+    // Resolve debug labels BEFORE encoding - after this dasm_getpclabel corrupts state
+    if (debug_info) {
+        for (int i = 0; i < debug_info->entry_count; i++) {
+            debug_map_entry_t *entry = &debug_info->entries[i];
+            int32_t ofs = dasm_getpclabel(Dst, entry->pc_label);
+            if (ofs >= 0) {
+                entry->pc_offset = (size_t)ofs;
+            }
+        }
+        bf_debug_sort(debug_info);
+
+        int32_t exit_ofs = dasm_getpclabel(Dst, exit_label);
+        int32_t cold_ofs = dasm_getpclabel(Dst, cold_label);
+        debug_info->code_size = size;
+        debug_info->exit_offset = exit_ofs >= 0 ? (size_t)exit_ofs : 0;
+        debug_info->cold_offset = cold_ofs >= 0 ? (size_t)cold_ofs : size;
+    }
+
+    if (dasm_encode(Dst, encode_at) != 0) {
+        codegen_error("DynASM encoding failed");
+        goto fail;
+    }
+
+    if (in_arena) {
+        // The code was written through another mapping of the same pages
+        __builtin___clear_cache((char *)code, (char *)code + size);
+    } else if (mprotect(code, size, PROT_READ | PROT_EXEC) != 0) {
+        codegen_error("Memory protection failed");
+        goto fail;
+    }
+
+    if (debug_mode) {
+        dump_code_hex(code, size);
+    }
+
+    if (code_ptr) *code_ptr = code;
+    if (code_size) *code_size = size;
+
+    dasm_free(Dst);
+    return (bf_func)code;
+
+fail:
+    // A failed arena block is not reused
+    if (code != MAP_FAILED && !in_arena) munmap(code, size);
+    dasm_free(Dst);
+    return NULL;
+}
+
+void bf_codegen_free(void *code, size_t size) {
+    if (code) munmap(code, size);
+}
+
+bf_lazy_t *bf_lazy_create(const bf_codegen_options_t *options) {
+    bf_lazy_t *lazy = calloc(1, sizeof(bf_lazy_t));
+    if (!lazy) {
+        perror("calloc");
+        exit(1);
+    }
+    lazy->options = *options;
+    lazy->options.prelude = NULL;
+    lazy->options.pgo = NULL;
+    lazy->options.counters = NULL;
+    lazy->options.debug_info = NULL;
+    lazy->options.fragment = true;
+    lazy->options.lazy = lazy;          // Nested large loops stay lazy
+    pthread_mutex_init(&lazy->lock, NULL);
+    return lazy;
+}
+
+int bf_lazy_compiled_loops(const bf_lazy_t *lazy, int *stubs, size_t *code_size) {
+    int count = 0;
+    size_t size = 0;
+    for (const lazy_slot_t *slot = lazy->slots; slot; slot = slot->next) {
+        if (slot->code) {
+            count++;
+            size += slot->code_size;
+        }
+    }
+    if (stubs) *stubs = lazy->stub_count;
+    if (code_size) *code_size = size;
+    return count;
+}
+
+void bf_lazy_free(bf_lazy_t *lazy) {
+    if (!lazy) return;
+    lazy_slot_t *slot = lazy->slots;
+    while (slot) {
+        lazy_slot_t *next = slot->next;
+        if (!bf_code_arena_owns(lazy->options.arena, slot->code)) {
+            bf_codegen_free(slot->code, slot->code_size);
+        }
+        free(slot);
+        slot = next;
+    }
+    pthread_mutex_destroy(&lazy->lock);
+    free(lazy);
+}
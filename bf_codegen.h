@@ -0,0 +1,83 @@
+#ifndef BF_CODEGEN_H
+#define BF_CODEGEN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+#include "bf_io.h"
+#include "bf_debug.h"
+#include "bf_peval.h"
+#include "bf_pgo.h"
+#include "bf_count.h"
+
+// Entry point of compiled code: memory is the initial cell, io the I/O
+// state (followed by the execution counters when compiled with counters)
+typedef int (*bf_func)(char *memory, bf_io_t *io);
+
+// Entry point of a loop compiled on its own (options.fragment): starts at
+// cell memory[offset] (masked into the tape in safe mode) and returns the
+// offset of the cell it stopped at
+typedef long (*bf_fragment_func)(char *memory, bf_io_t *io, long offset);
+
+// Loops compiled on first entry (options.lazy). The code for a large loop
+// is only a stub that calls through the loop's slot: the slot starts out
+// at a resolver, which compiles the body as a fragment and repoints the
+// slot at it, so later entries go straight to the compiled body.
+typedef struct bf_lazy bf_lazy_t;
+
+#define BF_LAZY_MIN_NODES 64        // Smaller loops are compiled in place
+
+// Code arena (options.arena): one region mapped both writable and
+// executable, where compilations append their code in whole pages instead
+// of mapping and reprotecting their own. Nothing in it is freed before the
+// arena; a compilation that does not fit maps its own code as usual.
+typedef struct bf_code_arena bf_code_arena_t;
+
+#define BF_CODE_ARENA_SIZE ((size_t)256 << 20)     // Reserved for --code-arena
+
+// Everything that shapes the generated code. Passed explicitly rather than
+// through globals, so compilations are independent of each other.
+typedef struct {
+    bool unsafe_mode;               // No tape masking (--unsafe)
+    bf_eof_mode_t eof_mode;         // EOF convention for ','
+    size_t memory_size;             // Safe mode tape size, a power of two
+    bool debug_mode;                // Dump the code, compile debug log calls
+    const bf_peval_t *prelude;      // Partially evaluated prefix, or NULL
+    const bf_pgo_t *pgo;            // Profile guiding code layout, or NULL
+    bf_counters_t *counters;        // Assigns counter slots, or NULL
+    bf_debug_info_t *debug_info;    // Collects the PC map, or NULL
+    bool fragment;                  // ast is one loop, compiled as a bf_fragment_func
+    bf_lazy_t *lazy;                // Compile large loops on first entry, or NULL
+    bf_code_arena_t *arena;         // Append the code here, or NULL to map it
+} bf_codegen_options_t;
+
+// Codegen functions. Compile returns NULL (after reporting why on stderr)
+// if the code could not be generated or mapped.
+bf_func bf_codegen_compile(ast_node_t *ast, const bf_codegen_options_t *options, void **code_ptr, size_t *code_size);
+void bf_codegen_free(void *code, size_t size);   // Not for code in an arena
+uint32_t bf_codegen_features(void);     // ISA extensions in use (part of the code cache key)
+uint64_t bf_codegen_id(void);           // Hash of the code templates (part of the code cache key)
+void bf_codegen_debug_log(int line, int column);
+
+// Lazy compilation functions. create takes the tape and I/O options the
+// loops are compiled with (prelude, profile, counters and debug map are
+// not used); the tree must outlive the code, which compiles loops from
+// it, and free unmaps every loop compiled so far. Resolving is thread-safe.
+bf_lazy_t *bf_lazy_create(const bf_codegen_options_t *options);
+int bf_lazy_compiled_loops(const bf_lazy_t *lazy, int *stubs, size_t *code_size);
+void bf_lazy_free(bf_lazy_t *lazy);
+
+// Code arena functions. create fails (NULL, errno set) where the system
+// cannot map one object twice or refuses executable shared mappings.
+bf_code_arena_t *bf_code_arena_create(size_t size);
+bool bf_code_arena_owns(const bf_code_arena_t *arena, const void *code);
+size_t bf_code_arena_used(const bf_code_arena_t *arena);
+void bf_code_arena_free(bf_code_arena_t *arena);
+
+// Tape memory with a guard page on either side
+char *allocate_guarded_memory(size_t size);
+void free_guarded_memory(char *memory, size_t size);
+size_t tape_size_pow2(size_t size);
+
+#endif // BF_CODEGEN_H
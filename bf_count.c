@@ -0,0 +1,99 @@
+#include "bf_count.h"
+#include "bf_debug.h"
+#include <stdlib.h>
+#include <string.h>
+
+void bf_counters_init(bf_counters_t *counters, bool nodes) {
+    memset(counters, 0, sizeof(*counters));
+    counters->nodes = nodes;
+}
+
+// Assign the next slot; returns its index
+int bf_counters_add(bf_counters_t *counters, ast_node_t *node, bf_count_kind_t kind) {
+    if (counters->count == counters->capacity) {
+        counters->capacity = counters->capacity ? counters->capacity * 2 : 256;
+        bf_count_slot_t *grown = realloc(counters->slots, (size_t)counters->capacity * sizeof(bf_count_slot_t));
+        if (!grown) {
+            perror("realloc");
+            exit(1);
+        }
+        counters->slots = grown;
+    }
+    counters->slots[counters->count] = (bf_count_slot_t){ node, kind };
+    return counters->count++;
+}
+
+// Copy the values the JIT produced into the nodes they count. A node can
+// own several slots (both copies of a safe mode block), so they add up.
+void bf_counters_apply(const bf_counters_t *counters, const uint64_t *values) {
+    for (int i = 0; i < counters->count; i++) {
+        ast_node_t *node = counters->slots[i].node;
+        node->profile_entries = 0;
+        node->profile_iterations = 0;
+        node->profile_runs = 0;
+    }
+    for (int i = 0; i < counters->count; i++) {
+        ast_node_t *node = counters->slots[i].node;
+        switch (counters->slots[i].kind) {
+            case BF_COUNT_ENTRIES:
+                node->profile_entries += values[i];
+                break;
+            case BF_COUNT_ITERATIONS:
+                node->profile_iterations += values[i];
+                break;
+            case BF_COUNT_RUNS:
+                node->profile_runs += values[i];
+                break;
+        }
+    }
+}
+
+void bf_counters_free(bf_counters_t *counters) {
+    free(counters->slots);
+    memset(counters, 0, sizeof(*counters));
+}
+
+static bool counts_loop(const ast_node_t *node) {
+    return node->type == AST_LOOP || node->type == AST_IF;
+}
+
+// Loop-only reports keep a subtree only if it holds a loop
+static bool has_loop(const ast_node_t *node) {
+    for (; node; node = node->next) {
+        if (counts_loop(node)) return true;
+    }
+    return false;
+}
+
+static int write_json_list(ast_node_t *node, bool nodes, int indent, FILE *out) {
+    bool first = true;
+    if (fprintf(out, "[") < 0) return -1;
+
+    for (; node; node = node->next) {
+        if (!nodes && !counts_loop(node)) continue;
+
+        fprintf(out, "%s\n%*s{\"type\": \"%s\", \"line\": %d, \"column\": %d",
+                first ? "" : ",", indent + 2, "", debug_node_type_name(node->type), node->line, node->column);
+        first = false;
+
+        if (counts_loop(node)) {
+            fprintf(out, ", \"entries\": %llu, \"iterations\": %llu",
+                    (unsigned long long)node->profile_entries, (unsigned long long)node->profile_iterations);
+            if (node->data.loop.body && (nodes || has_loop(node->data.loop.body))) {
+                fprintf(out, ", \"body\": ");
+                if (write_json_list(node->data.loop.body, nodes, indent + 2, out) != 0) return -1;
+            }
+        } else {
+            fprintf(out, ", \"runs\": %llu", (unsigned long long)node->profile_runs);
+        }
+        if (fprintf(out, "}") < 0) return -1;
+    }
+
+    return fprintf(out, first ? "]" : "\n%*s]", indent, "") < 0 ? -1 : 0;
+}
+
+int bf_count_write_json(ast_node_t *ast, bool nodes, FILE *out) {
+    if (fprintf(out, "{\"mode\": \"%s\", \"nodes\": ", nodes ? "nodes" : "loops") < 0) return -1;
+    if (write_json_list(ast, nodes, 0, out) != 0) return -1;
+    return fprintf(out, "}\n") < 0 ? -1 : 0;
+}
@@ -0,0 +1,40 @@
+#ifndef BF_COUNT_H
+#define BF_COUNT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+
+// Exact execution counters (--count, and the loop counts of --pgo-out).
+// Codegen assigns one 64-bit slot per counted event; the JIT increments
+// it in place with no call. The values live right after the bf_io_t, so
+// code addresses them relative to the I/O state register.
+typedef enum {
+    BF_COUNT_ENTRIES,           // LOOP/IF reached
+    BF_COUNT_ITERATIONS,        // LOOP/IF body ran
+    BF_COUNT_RUNS,              // Any other node ran (--count=nodes)
+} bf_count_kind_t;
+
+typedef struct {
+    ast_node_t *node;
+    bf_count_kind_t kind;
+} bf_count_slot_t;
+
+typedef struct {
+    bf_count_slot_t *slots;
+    int count;
+    int capacity;
+    bool nodes;                 // Count every node, not only loops
+} bf_counters_t;
+
+// Counter functions
+void bf_counters_init(bf_counters_t *counters, bool nodes);
+int bf_counters_add(bf_counters_t *counters, ast_node_t *node, bf_count_kind_t kind);
+void bf_counters_apply(const bf_counters_t *counters, const uint64_t *values);
+void bf_counters_free(bf_counters_t *counters);
+
+// Report counts stored in the tree by bf_counters_apply
+int bf_count_write_json(ast_node_t *ast, bool nodes, FILE *out);
+
+#endif // BF_COUNT_H
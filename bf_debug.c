@@ -30,11 +30,13 @@ int bf_debug_get_node_data(ast_node_t *node) {
         case AST_MOVE_PTR:
         case AST_ADD_VAL:
         case AST_SET_CONST:
+        case AST_SCAN:
             return node->data.basic.count;
         case AST_OUTPUT:
         case AST_INPUT:
             return node->data.basic.offset;
         case AST_MUL:
+        case AST_MUL2:
             return node->data.mul.multiplier;
         case AST_LOOP:
         default:
@@ -63,31 +65,138 @@ void bf_debug_add_mapping(bf_debug_info_t *debug, int pc_label, ast_node_t *node
     entry->source_line = source_line;
     entry->source_column = source_column;
     entry->node_data = bf_debug_get_node_data(node);
+    entry->node = node;
 }
 
-// Find debug entry by PC address
+static int compare_entry_pc(const void *a, const void *b) {
+    const debug_map_entry_t *x = a;
+    const debug_map_entry_t *y = b;
+    if (x->pc_offset != y->pc_offset) return (x->pc_offset > y->pc_offset) - (x->pc_offset < y->pc_offset);
+    return (x->pc_label > y->pc_label) - (x->pc_label < y->pc_label);
+}
+
+// Order entries by PC once the offsets are resolved. Code is not laid out
+// in label order (cold loops follow the epilogue), and nodes that emit no
+// code share a PC with the next one, which keeps its place after them.
+void bf_debug_sort(bf_debug_info_t *debug) {
+    if (!debug || debug->entry_count == 0) return;
+    qsort(debug->entries, (size_t)debug->entry_count, sizeof(debug_map_entry_t), compare_entry_pc);
+}
+
+// Index of the first entry above offset in the sorted map
+static int entry_after(const bf_debug_info_t *debug, size_t offset) {
+    int lo = 0, hi = debug->entry_count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (debug->entries[mid].pc_offset <= offset) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+size_t bf_debug_region_end(const bf_debug_info_t *debug, size_t offset) {
+    int next = entry_after(debug, offset);
+    size_t end = next < debug->entry_count ? debug->entries[next].pc_offset : debug->code_size;
+    if (debug->exit_offset > offset && debug->exit_offset < end) end = debug->exit_offset;
+    if (debug->cold_offset > offset && debug->cold_offset < end) end = debug->cold_offset;
+    return end;
+}
+
+size_t bf_debug_entry_end(const bf_debug_info_t *debug, int i) {
+    size_t start = debug->entries[i].pc_offset;
+    bool shared = (i + 1 < debug->entry_count && debug->entries[i + 1].pc_offset == start) ||
+                  (debug->exit_offset > 0 && debug->exit_offset == start) ||
+                  (debug->cold_offset > 0 && debug->cold_offset <= start);
+    return shared ? start : bf_debug_region_end(debug, start);
+}
+
+// Find the debug entry whose code contains pc: the last entry at or below
+// it in the sorted map, unless its code ends first and pc is in the
+// prologue, epilogue or cold section. Only reads the map, so it is
+// async-signal-safe.
 debug_map_entry_t *bf_debug_find_by_pc(bf_debug_info_t *debug, void *pc) {
     if (!debug || !pc) return NULL;
 
     size_t offset = (char *)pc - (char *)debug->code_start;
     if (offset >= debug->code_size) return NULL;
 
-    // Find closest mapping (linear search for now)
-    debug_map_entry_t *best = NULL;
-    size_t best_distance = SIZE_MAX;
+    int i = entry_after(debug, offset) - 1;
+    if (i < 0 || offset >= bf_debug_entry_end(debug, i)) return NULL;
+    return &debug->entries[i];
+}
+
+typedef struct {
+    ast_node_t *node;
+    int order;                  // Pre-order position, so the first match wins
+} debug_node_ref_t;
+
+static int compare_node_ref(const void *a, const void *b) {
+    const debug_node_ref_t *x = a;
+    const debug_node_ref_t *y = b;
+    if (x->node->line != y->node->line) return (x->node->line > y->node->line) - (x->node->line < y->node->line);
+    if (x->node->column != y->node->column) return (x->node->column > y->node->column) - (x->node->column < y->node->column);
+    return (x->order > y->order) - (x->order < y->order);
+}
+
+static int collect_node_refs(ast_node_t *node, debug_node_ref_t *refs, int n) {
+    for (; node; node = node->next) {
+        refs[n].node = node;
+        refs[n].order = n;
+        n++;
+        if (ast_has_body(node)) {
+            n = collect_node_refs(node->data.loop.body, refs, n);
+        }
+    }
+    return n;
+}
+
+// Entries loaded from the code cache carry no node pointers. Match them to
+// the tree by source location through one sorted index, preferring a node
+// of the same type, rather than searching the tree per entry.
+int bf_debug_resolve_nodes(bf_debug_info_t *debug, ast_node_t *ast) {
+    int unresolved = 0;
+    for (int i = 0; i < debug->entry_count; i++) {
+        if (!debug->entries[i].node) unresolved++;
+    }
+    if (unresolved == 0 || !ast) return 0;
+
+    int count = ast_count_nodes(ast);
+    debug_node_ref_t *refs = malloc((size_t)count * sizeof(debug_node_ref_t));
+    if (!refs) return -1;
+    count = collect_node_refs(ast, refs, 0);
+    qsort(refs, (size_t)count, sizeof(debug_node_ref_t), compare_node_ref);
 
     for (int i = 0; i < debug->entry_count; i++) {
         debug_map_entry_t *entry = &debug->entries[i];
-        if (entry->pc_offset <= offset) {
-            size_t distance = offset - entry->pc_offset;
-            if (distance < best_distance) {
-                best = entry;
-                best_distance = distance;
+        if (entry->node) continue;
+
+        // First index with a location at or after the entry's
+        int lo = 0, hi = count;
+        while (lo < hi) {
+            int mid = lo + (hi - lo) / 2;
+            ast_node_t *node = refs[mid].node;
+            if (node->line < entry->source_line ||
+                (node->line == entry->source_line && node->column < entry->source_column)) {
+                lo = mid + 1;
+            } else {
+                hi = mid;
+            }
+        }
+        for (int j = lo; j < count && refs[j].node->line == entry->source_line &&
+                         refs[j].node->column == entry->source_column; j++) {
+            if (!entry->node) entry->node = refs[j].node;
+            if (refs[j].node->type == entry->node_type) {
+                entry->node = refs[j].node;
+                break;
             }
         }
     }
 
-    return best;
+    free(refs);
+    return 0;
 }
 
 const char* debug_node_type_name(ast_node_type_t type) {
@@ -97,8 +206,12 @@ const char* debug_node_type_name(ast_node_type_t type) {
         case AST_OUTPUT: return "OUTPUT";
         case AST_INPUT: return "INPUT";
         case AST_LOOP: return "LOOP";
+        case AST_IF: return "IF";
+        case AST_DEBUG_LOG: return "DEBUG_LOG";
         case AST_SET_CONST: return "SET_CONST";
         case AST_MUL: return "MUL";
+        case AST_SCAN: return "SCAN";
+        case AST_MUL2: return "MUL2";
         default: return "UNKNOWN";
     }
 }
@@ -119,6 +232,8 @@ void bf_debug_dump_mappings(bf_debug_info_t *debug, FILE *out) {
             case AST_ADD_VAL:
             case AST_SET_CONST:
             case AST_MUL:
+            case AST_MUL2:
+            case AST_SCAN:
                 fprintf(out, " [%d]", entry->node_data);
                 break;
             default:
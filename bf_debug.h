@@ -12,6 +12,7 @@ typedef struct {
     int source_line;            // Line in original BF source
     int source_column;          // Column in original BF source
     int node_data;              // Node-specific data (count, offset, etc.)
+    ast_node_t *node;           // Node the code belongs to (NULL when loaded from the code cache)
 } debug_map_entry_t;
 
 // Debug info for JIT code
@@ -21,12 +22,24 @@ typedef struct {
     int max_entries;            // Capacity
     void *code_start;           // Start of JIT code
     size_t code_size;           // Size of JIT code
+    size_t exit_offset;         // Start of the epilogue, 0 if unknown
+    size_t cold_offset;         // Start of the cold section (code size without one), 0 if unknown
 } bf_debug_info_t;
 
 // Debug info functions
 int bf_debug_init(bf_debug_info_t *debug, void *code_start, size_t code_size);
 void bf_debug_add_mapping(bf_debug_info_t *debug, int pc_label, ast_node_t *node, int source_line, int source_column);
+void bf_debug_sort(bf_debug_info_t *debug);
+int bf_debug_resolve_nodes(bf_debug_info_t *debug, ast_node_t *ast);
 debug_map_entry_t *bf_debug_find_by_pc(bf_debug_info_t *debug, void *pc);
+
+// Code ranges in the sorted map. The region starting at offset (the
+// prologue at 0, the epilogue at exit_offset) ends at the next label above
+// it, the epilogue or the cold section. An entry's code ends the same way,
+// or where it starts if it emitted none: the next entry, the epilogue or
+// the cold section starts at the same offset.
+size_t bf_debug_region_end(const bf_debug_info_t *debug, size_t offset);
+size_t bf_debug_entry_end(const bf_debug_info_t *debug, int i);
 void bf_debug_dump_mappings(bf_debug_info_t *debug, FILE *out);
 void bf_debug_cleanup(bf_debug_info_t *debug);
 
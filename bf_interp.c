@@ -0,0 +1,293 @@
+#include "bf_interp.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+
+typedef enum {
+    OP_MOVE,        // a: count
+    OP_ADD,         // a: offset, b: count
+    OP_SET,         // a: offset, b: value
+    OP_MUL,         // a: source, b: target, c: multiplier
+    OP_MUL2,        // a: source, b: second source, c: target, d: multiplier
+    OP_SCAN,        // a: stride
+    OP_OUTPUT,      // a: offset
+    OP_INPUT,       // a: offset
+    OP_DEBUG_LOG,   // a: line, b: column
+    OP_LOOP,        // a: instruction after the loop, c: loop
+    OP_END,         // a: first instruction of the body, c: loop
+    OP_IF,          // a: instruction after the body
+    OP_EXIT,
+    OP_COUNT
+} interp_op_t;
+
+typedef struct {
+    const void *handler;        // Code for op (direct threading), set by the first run
+    interp_op_t op;
+    int a, b, c, d;
+} interp_insn_t;
+
+typedef struct {
+    ast_node_t *node;           // Tree the fragment is compiled from
+    long back_edges;
+    bf_fragment_func code;      // Compiled loop, NULL while interpreted
+    void *code_ptr;
+    size_t code_size;
+} interp_loop_t;
+
+struct bf_interp {
+    interp_insn_t *insns;
+    int insn_count;
+    int insn_capacity;
+    interp_loop_t *loops;
+    int loop_count;
+    int loop_capacity;
+    bf_codegen_options_t options;   // Fragment options: no prelude, counters or debug map
+    const bf_peval_t *prelude;
+    long hot_threshold;             // Back-edge count that compiles a loop, LONG_MAX for never
+    bool jit_failed;                // Code could not be generated or mapped: stop trying
+    bool threaded;                  // Handlers resolved
+};
+
+static int interp_emit(bf_interp_t *interp, interp_op_t op, int a, int b, int c, int d) {
+    if (interp->insn_count == interp->insn_capacity) {
+        interp->insn_capacity = interp->insn_capacity ? interp->insn_capacity * 2 : 256;
+        interp->insns = realloc(interp->insns, (size_t)interp->insn_capacity * sizeof(interp_insn_t));
+        if (!interp->insns) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    interp->insns[interp->insn_count] = (interp_insn_t){ NULL, op, a, b, c, d };
+    return interp->insn_count++;
+}
+
+static int interp_add_loop(bf_interp_t *interp, ast_node_t *node) {
+    if (interp->loop_count == interp->loop_capacity) {
+        interp->loop_capacity = interp->loop_capacity ? interp->loop_capacity * 2 : 16;
+        interp->loops = realloc(interp->loops, (size_t)interp->loop_capacity * sizeof(interp_loop_t));
+        if (!interp->loops) {
+            perror("realloc");
+            exit(1);
+        }
+    }
+    interp->loops[interp->loop_count] = (interp_loop_t){ .node = node };
+    return interp->loop_count++;
+}
+
+static void interp_build(bf_interp_t *interp, ast_node_t *node) {
+    for (; node; node = node->next) {
+        int head, loop;
+
+        switch (node->type) {
+            case AST_MOVE_PTR:
+                interp_emit(interp, OP_MOVE, node->data.basic.count, 0, 0, 0);
+                break;
+            case AST_ADD_VAL:
+                interp_emit(interp, OP_ADD, node->data.basic.offset, node->data.basic.count, 0, 0);
+                break;
+            case AST_SET_CONST:
+                interp_emit(interp, OP_SET, node->data.basic.offset, node->data.basic.count, 0, 0);
+                break;
+            case AST_MUL:
+                if (node->data.mul.multiplier == 0) break;
+                interp_emit(interp, OP_MUL, node->data.mul.src_offset, node->data.mul.dst_offset,
+                            node->data.mul.multiplier, 0);
+                break;
+            case AST_MUL2:
+                if (node->data.mul.multiplier == 0) break;
+                interp_emit(interp, OP_MUL2, node->data.mul.src_offset, node->data.mul.src2_offset,
+                            node->data.mul.dst_offset, node->data.mul.multiplier);
+                break;
+            case AST_SCAN:
+                interp_emit(interp, OP_SCAN, node->data.basic.count, 0, 0, 0);
+                break;
+            case AST_OUTPUT:
+                interp_emit(interp, OP_OUTPUT, node->data.basic.offset, 0, 0, 0);
+                break;
+            case AST_INPUT:
+                interp_emit(interp, OP_INPUT, node->data.basic.offset, 0, 0, 0);
+                break;
+            case AST_DEBUG_LOG:
+                // Like compiled code, '!' only reports in --debug mode
+                if (interp->options.debug_mode) {
+                    interp_emit(interp, OP_DEBUG_LOG, node->line, node->column, 0, 0);
+                }
+                break;
+            case AST_LOOP:
+                loop = interp_add_loop(interp, node);
+                head = interp_emit(interp, OP_LOOP, 0, 0, loop, 0);
+                interp_build(interp, node->data.loop.body);
+                interp_emit(interp, OP_END, head + 1, 0, loop, 0);
+                interp->insns[head].a = interp->insn_count;
+                break;
+            case AST_IF:
+                head = interp_emit(interp, OP_IF, 0, 0, 0, 0);
+                interp_build(interp, node->data.loop.body);
+                interp->insns[head].a = interp->insn_count;
+                break;
+        }
+    }
+}
+
+bf_interp_t *bf_interp_create(ast_node_t *ast, const bf_codegen_options_t *options, long hot_threshold) {
+    bf_interp_t *interp = calloc(1, sizeof(bf_interp_t));
+    if (!interp) {
+        perror("calloc");
+        exit(1);
+    }
+    interp->options = *options;
+    interp->options.prelude = NULL;
+    interp->options.pgo = NULL;
+    interp->options.counters = NULL;
+    interp->options.debug_info = NULL;
+    interp->options.fragment = true;
+    interp->prelude = options->prelude;
+    interp->hot_threshold = hot_threshold > 0 ? hot_threshold : LONG_MAX;
+
+    interp_build(interp, ast);
+    interp_emit(interp, OP_EXIT, 0, 0, 0, 0);
+    return interp;
+}
+
+static void interp_compile(bf_interp_t *interp, interp_loop_t *loop) {
+    if (interp->jit_failed) return;
+
+    if (!bf_codegen_compile(loop->node, &interp->options, &loop->code_ptr, &loop->code_size)) {
+        fprintf(stderr, "Warning: Could not compile hot loop, interpreting it\n");
+        interp->jit_failed = true;
+        return;
+    }
+    loop->code = (bf_fragment_func)loop->code_ptr;
+    if (interp->options.debug_mode) {
+        fprintf(stderr, "Tier-up: loop at line %d, column %d after %ld iterations (%zu bytes)\n",
+                loop->node->line, loop->node->column, loop->back_edges, loop->code_size);
+    }
+}
+
+void bf_interp_run(bf_interp_t *interp, char *memory, bf_io_t *io) {
+    static const void *const handlers[OP_COUNT] = {
+        [OP_MOVE] = &&op_move, [OP_ADD] = &&op_add, [OP_SET] = &&op_set,
+        [OP_MUL] = &&op_mul, [OP_MUL2] = &&op_mul2, [OP_SCAN] = &&op_scan,
+        [OP_OUTPUT] = &&op_output, [OP_INPUT] = &&op_input, [OP_DEBUG_LOG] = &&op_debug_log,
+        [OP_LOOP] = &&op_loop, [OP_END] = &&op_end, [OP_IF] = &&op_if, [OP_EXIT] = &&op_exit,
+    };
+    if (!interp->threaded) {
+        for (int i = 0; i < interp->insn_count; i++) {
+            interp->insns[i].handler = handlers[interp->insns[i].op];
+        }
+        interp->threaded = true;
+    }
+
+    // Cells are base[(pos + offset) & mask]: the compiled code's wrapping
+    // in safe mode, plain pointer arithmetic in unsafe mode
+    unsigned char *base = (unsigned char *)memory;
+    size_t mask = interp->options.unsafe_mode ? SIZE_MAX : interp->options.memory_size - 1;
+    size_t pos = 0;
+    const interp_insn_t *insns = interp->insns;
+    const interp_insn_t *ip = insns;
+    interp_loop_t *loop;
+    int value;
+
+#define CELL(offset) base[(ptrdiff_t)((pos + (size_t)(long)(offset)) & mask)]
+#define NEXT() goto *(++ip)->handler
+#define JUMP(index) do { ip = insns + (index); goto *ip->handler; } while (0)
+#define ENTER(loop) (pos = (size_t)(loop)->code((char *)base, io, \
+                         interp->options.unsafe_mode ? (long)pos : (long)(pos & mask)))
+
+    const bf_peval_t *prelude = interp->prelude;
+    if (prelude) {
+        for (size_t i = 0; i < prelude->image_size; i++) {
+            CELL(prelude->image_start + (long)i) = prelude->image[i];
+        }
+        if (prelude->output_size > 0) io->write(io, prelude->output, prelude->output_size);
+    }
+
+    goto *ip->handler;
+
+op_move:
+    pos += (size_t)(long)ip->a;
+    NEXT();
+op_add:
+    CELL(ip->a) += (unsigned char)ip->b;
+    NEXT();
+op_set:
+    CELL(ip->a) = (unsigned char)ip->b;
+    NEXT();
+op_mul:
+    CELL(ip->b) += (unsigned char)(CELL(ip->a) * ip->c);
+    NEXT();
+op_mul2:
+    CELL(ip->c) += (unsigned char)(CELL(ip->a) * CELL(ip->b) * ip->d);
+    NEXT();
+op_scan:
+    while (CELL(0) != 0) pos += (size_t)(long)ip->a;
+    NEXT();
+op_output:
+    if (io->out_pos == io->out_end) io->flush(io);
+    *io->out_pos++ = CELL(ip->a);
+    NEXT();
+op_input:
+    value = io->in_pos < io->in_end ? *io->in_pos++ : io->refill(io);
+    if (value >= 0) CELL(ip->a) = (unsigned char)value;     // -1: --eof unchanged
+    NEXT();
+op_debug_log:
+    io->debug_log(ip->a, ip->b);
+    NEXT();
+op_loop:
+    if (CELL(0) == 0) JUMP(ip->a);
+    loop = &interp->loops[ip->c];
+    if (loop->code) {
+        ENTER(loop);
+        JUMP(ip->a);
+    }
+    NEXT();
+op_end:
+    if (CELL(0) == 0) NEXT();
+    loop = &interp->loops[ip->c];
+    if (++loop->back_edges == interp->hot_threshold) {
+        interp_compile(interp, loop);
+        if (loop->code) {
+            // The cell is nonzero: the remaining iterations run natively
+            ENTER(loop);
+            NEXT();
+        }
+    }
+    JUMP(ip->a);
+op_if:
+    if (CELL(0) == 0) JUMP(ip->a);
+    NEXT();
+op_exit:
+    return;
+
+#undef CELL
+#undef NEXT
+#undef JUMP
+#undef ENTER
+}
+
+int bf_interp_compiled_loops(const bf_interp_t *interp, size_t *code_size) {
+    int count = 0;
+    size_t size = 0;
+    for (int i = 0; i < interp->loop_count; i++) {
+        if (interp->loops[i].code) {
+            count++;
+            size += interp->loops[i].code_size;
+        }
+    }
+    if (code_size) *code_size = size;
+    return count;
+}
+
+void bf_interp_free(bf_interp_t *interp) {
+    if (!interp) return;
+    for (int i = 0; i < interp->loop_count; i++) {
+        if (!bf_code_arena_owns(interp->options.arena, interp->loops[i].code_ptr)) {
+            bf_codegen_free(interp->loops[i].code_ptr, interp->loops[i].code_size);
+        }
+    }
+    free(interp->loops);
+    free(interp->insns);
+    free(interp);
+}
@@ -0,0 +1,33 @@
+#ifndef BF_INTERP_H
+#define BF_INTERP_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+#include "bf_io.h"
+#include "bf_codegen.h"
+
+#define BF_INTERP_HOT_LOOP 1000     // Back-edges before --tier=auto compiles a loop
+
+// Execution tier (--tier)
+typedef enum {
+    BF_TIER_JIT,                // Compile the whole program up front (default)
+    BF_TIER_INTERP,             // Interpret only, never map executable memory
+    BF_TIER_AUTO,               // Interpret, compile loops once they are hot
+} bf_tier_t;
+
+// Direct-threaded interpreter over the optimized tree. Loops count their
+// back-edges; once one crosses the threshold it is compiled on its own as
+// a bf_fragment_func and entered at its head from then on (on-stack
+// replacement: the current iteration continues in native code).
+typedef struct bf_interp bf_interp_t;
+
+// Interpreter functions. options describes the tape and I/O exactly as for
+// bf_codegen_compile (prelude included); hot_threshold 0 never compiles.
+// The tree must outlive the interpreter, which compiles hot loops from it.
+bf_interp_t *bf_interp_create(ast_node_t *ast, const bf_codegen_options_t *options, long hot_threshold);
+void bf_interp_run(bf_interp_t *interp, char *memory, bf_io_t *io);
+int bf_interp_compiled_loops(const bf_interp_t *interp, size_t *code_size);
+void bf_interp_free(bf_interp_t *interp);
+
+#endif // BF_INTERP_H
@@ -0,0 +1,242 @@
+#define _GNU_SOURCE
+#include "bf_io.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+
+static ssize_t fd_read(void *ctx, void *buf, size_t size) {
+    return read(((bf_io_t *)ctx)->in_fd, buf, size);
+}
+
+static ssize_t fd_write(void *ctx, const void *buf, size_t size) {
+    return write(((bf_io_t *)ctx)->out_fd, buf, size);
+}
+
+void bf_io_init(bf_io_t *io, int in_fd, int out_fd, bf_eof_mode_t eof_mode) {
+    bf_io_callbacks_t callbacks = { fd_read, fd_write, io };
+    bf_io_init_callbacks(io, &callbacks, eof_mode);
+    io->out_fd = out_fd;
+    io->in_fd = in_fd;
+    io->exit_on_error = true;
+}
+
+void bf_io_init_callbacks(bf_io_t *io, const bf_io_callbacks_t *callbacks, bf_eof_mode_t eof_mode) {
+    io->out_pos = io->out_buf;
+    io->out_end = io->out_buf + BF_IO_OUTPUT_BUFFER_SIZE;
+    io->in_pos = io->in_buf;
+    io->in_end = io->in_buf;
+    io->out_start = io->out_buf;
+    io->out_fd = -1;
+    io->in_fd = -1;
+    io->callbacks = *callbacks;
+    io->exit_on_error = false;
+    io->error = 0;
+    io->bytes_read = 0;
+    io->bytes_written = 0;
+    io->eof_mode = eof_mode;
+    io->flush = bf_io_flush;
+    io->refill = bf_io_refill;
+    io->write = bf_io_write;
+    io->debug_log = NULL;
+    io->in_map = NULL;
+    io->in_map_size = 0;
+    io->pipe_buf = NULL;
+    io->pipe_half = 0;
+}
+
+static void io_failed(bf_io_t *io, const char *what) {
+    if (io->exit_on_error) {
+        char msg[32];
+        snprintf(msg, sizeof(msg), "Error: %s failed", what);
+        perror(msg);
+        exit(1);
+    }
+    if (!io->error) {
+        io->error = errno ? errno : EIO;
+    }
+}
+
+#ifdef __linux__
+// Hand a full pipe buffer half to the pipe and switch to the other half.
+// The pages stay referenced until the reader consumes them; the other
+// half is as large as the pipe, so once it has gone in too they are free.
+static void pipe_splice(bf_io_t *io) {
+    struct iovec iov = { io->out_start, (size_t)(io->out_pos - io->out_start) };
+
+    while (iov.iov_len > 0) {
+        errno = 0;
+        ssize_t n = vmsplice(io->out_fd, &iov, 1, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            io_failed(io, "vmsplice");
+            break;
+        }
+        iov.iov_base = (unsigned char *)iov.iov_base + n;
+        iov.iov_len -= (size_t)n;
+        io->bytes_written += (size_t)n;
+    }
+
+    io->out_start = io->out_start == io->pipe_buf ? io->pipe_buf + io->pipe_half : io->pipe_buf;
+    io->out_pos = io->out_start;
+    io->out_end = io->out_start + io->pipe_half;
+}
+#endif
+
+static void write_all(bf_io_t *io, const unsigned char *p, size_t size) {
+    const unsigned char *end = p + size;
+
+    while (p < end) {
+        errno = 0;
+        ssize_t n = io->callbacks.write(io->callbacks.ctx, p, (size_t)(end - p));
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) {
+            io_failed(io, "write");
+            break;
+        }
+        p += n;
+        io->bytes_written += (size_t)n;
+    }
+}
+
+// Write out everything between out_start and out_pos, then rewind out_pos.
+// Called from JIT code when the buffer is full and from C at exit.
+void bf_io_flush(bf_io_t *io) {
+#ifdef __linux__
+    // Only full halves are spliced: a partial one (a prompt before input,
+    // the end of the run) is copied, so the half can be refilled at once
+    if (io->pipe_buf && io->out_pos == io->out_end) {
+        pipe_splice(io);
+        return;
+    }
+#endif
+    write_all(io, io->out_start, (size_t)(io->out_pos - io->out_start));
+    io->out_pos = io->out_start;
+}
+
+// Output a block of bytes after what is buffered: copied into the buffer
+// if it fits, else the buffer is flushed and the block goes out in one
+// write. Used for the partial evaluation output, which can be megabytes.
+void bf_io_write(bf_io_t *io, const void *data, size_t size) {
+    if (size <= (size_t)(io->out_end - io->out_pos)) {
+        memcpy(io->out_pos, data, size);
+        io->out_pos += size;
+        return;
+    }
+    bf_io_flush(io);
+    write_all(io, data, size);
+}
+
+// Refill the input buffer with one read and consume its first byte.
+// Called from JIT code only when in_pos has reached in_end. Returns the
+// byte, or on EOF the value for the configured convention; -1 means
+// "leave the cell unchanged" and is only returned in BF_EOF_UNCHANGED mode.
+int bf_io_refill(bf_io_t *io) {
+    // Flush pending output first so interactive prompts are visible
+    bf_io_flush(io);
+
+    // A mapped file was all in view from the start
+    ssize_t n = 0;
+    while (!io->in_map) {
+        errno = 0;
+        n = io->callbacks.read(io->callbacks.ctx, io->in_buf, BF_IO_INPUT_BUFFER_SIZE);
+        if (!(n < 0 && errno == EINTR)) break;
+    }
+
+    if (n <= 0) {
+        if (n < 0) {
+            io_failed(io, "read");
+        }
+        // A mapped file stays at its end, where the cursor counts it all
+        if (!io->in_map) io->in_pos = io->in_end = io->in_buf;
+        switch (io->eof_mode) {
+            case BF_EOF_MINUS_ONE: return 255;
+            case BF_EOF_UNCHANGED: return -1;
+            case BF_EOF_ZERO:
+            default: return 0;
+        }
+    }
+
+    io->bytes_read += (size_t)n;
+    io->in_pos = io->in_buf + 1;
+    io->in_end = io->in_buf + n;
+    return io->in_buf[0];
+}
+
+// Input consumed so far: whole reads, and mapped input up to the cursor
+size_t bf_io_bytes_read(const bf_io_t *io) {
+    return io->bytes_read + (io->in_map ? (size_t)(io->in_pos - io->in_map) : 0);
+}
+
+int bf_io_map_input(bf_io_t *io) {
+    struct stat st;
+    if (io->in_fd < 0 || fstat(io->in_fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0) {
+        return -1;
+    }
+
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, io->in_fd, 0);
+    if (map == MAP_FAILED) return -1;
+#ifdef MADV_SEQUENTIAL
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+#endif
+
+    io->in_map = map;
+    io->in_map_size = (size_t)st.st_size;
+    io->in_pos = io->in_map;
+    io->in_end = io->in_map + io->in_map_size;
+    return 0;
+}
+
+int bf_io_pipe_output(bf_io_t *io) {
+#if defined(__linux__) && defined(F_SETPIPE_SZ)
+    struct stat st;
+    if (io->pipe_buf || io->out_fd < 0 || fstat(io->out_fd, &st) != 0 || !S_ISFIFO(st.st_mode)) {
+        return -1;
+    }
+
+    // Ask for a larger pipe, but take what it is: raising it can fail
+    // past /proc/sys/fs/pipe-max-size. The halves are at least as large as
+    // the normal buffer.
+    (void)fcntl(io->out_fd, F_SETPIPE_SZ, BF_IO_PIPE_SIZE);
+    int capacity = fcntl(io->out_fd, F_GETPIPE_SZ);
+    if (capacity < BF_IO_OUTPUT_BUFFER_SIZE || capacity > 16 * BF_IO_PIPE_SIZE) return -1;
+
+    size_t half = (size_t)capacity;
+    void *buf = mmap(NULL, 2 * half, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (buf == MAP_FAILED) return -1;
+
+    bf_io_flush(io);
+    io->pipe_buf = buf;
+    io->pipe_half = half;
+    io->out_start = io->pipe_buf;
+    io->out_pos = io->out_start;
+    io->out_end = io->out_start + half;
+    return 0;
+#else
+    (void)io;
+    return -1;
+#endif
+}
+
+// The pipe keeps its own references to spliced pages, so unmapping the
+// buffer does not disturb data the reader has not consumed yet
+void bf_io_release(bf_io_t *io) {
+    if (io->in_map) {
+        io->bytes_read = bf_io_bytes_read(io);
+        munmap(io->in_map, io->in_map_size);
+        io->in_map = NULL;
+        io->in_pos = io->in_end = io->in_buf;
+    }
+    if (io->pipe_buf) {
+        bf_io_flush(io);
+        munmap(io->pipe_buf, 2 * io->pipe_half);
+        io->pipe_buf = NULL;
+        io->out_start = io->out_pos = io->out_buf;
+        io->out_end = io->out_buf + BF_IO_OUTPUT_BUFFER_SIZE;
+    }
+}
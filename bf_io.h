@@ -0,0 +1,88 @@
+#ifndef BF_IO_H
+#define BF_IO_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include <sys/types.h>
+
+#define BF_IO_OUTPUT_BUFFER_SIZE 65536
+#define BF_IO_INPUT_BUFFER_SIZE 65536
+#define BF_IO_PIPE_SIZE (1 << 20)       // Pipe capacity bf_io_pipe_output asks for
+
+// What ',' stores once the input is exhausted
+typedef enum {
+    BF_EOF_ZERO,        // Store 0 (default)
+    BF_EOF_MINUS_ONE,   // Store -1 (255)
+    BF_EOF_UNCHANGED,   // Leave the cell as it was
+} bf_eof_mode_t;
+
+// Byte streams behind the buffers, in the style of read(2)/write(2): return
+// the number of bytes transferred, 0 at end of input, or -1 on failure
+typedef struct {
+    ssize_t (*read)(void *ctx, void *buf, size_t size);
+    ssize_t (*write)(void *ctx, const void *buf, size_t size);
+    void *ctx;
+} bf_io_callbacks_t;
+
+// Buffered I/O state shared between the C runtime and JIT code.
+// The JIT keeps out_pos in a register while running and spills it
+// back here before calling into C (and at exit). in_pos/in_end are
+// read and advanced inline; bf_io_refill() is only called when empty.
+// JIT code reaches C only through the call table below, so it embeds no
+// absolute addresses and stays valid when cached on disk across ASLR.
+// With --count the 64-bit execution counters follow the struct in the same
+// allocation, so counted code reaches them through the same register.
+// Code only ever sees the four cursors, so they may point elsewhere than
+// the two buffers: into a mapped input file, or into a pipe buffer half.
+typedef struct bf_io bf_io_t;
+
+struct bf_io {
+    unsigned char *out_pos;     // Next free byte in the output buffer
+    unsigned char *out_end;     // One past its last usable byte
+    unsigned char *in_pos;      // Next unread input byte
+    unsigned char *in_end;      // One past the last valid input byte
+    unsigned char *out_start;   // Start of the output buffer: out_buf, or a pipe buffer half
+    int out_fd;                 // Descriptor the output buffer is flushed to
+    int in_fd;                  // Descriptor the input buffer is refilled from
+    bf_io_callbacks_t callbacks;    // Reads and writes in_fd/out_fd unless replaced
+    bool exit_on_error;         // Exit on a failed read or write instead of recording it
+    int error;                  // errno of the first failed read or write, 0 if none
+    size_t bytes_read;          // Read into in_buf so far (bf_io_bytes_read adds mapped input)
+    size_t bytes_written;       // Written out of out_buf so far
+    bf_eof_mode_t eof_mode;     // EOF convention for ','
+    void (*flush)(bf_io_t *io);                 // bf_io_flush
+    int (*refill)(bf_io_t *io);                 // bf_io_refill
+    void (*write)(bf_io_t *io, const void *data, size_t size);  // bf_io_write
+    void (*debug_log)(int line, int column);    // '#' hook in --debug mode (set by the JIT)
+    unsigned char *in_map;      // in_fd mapped whole (bf_io_map_input), NULL when reading it
+    size_t in_map_size;
+    unsigned char *pipe_buf;    // Two halves of pipe_half bytes (bf_io_pipe_output), or NULL
+    size_t pipe_half;
+    unsigned char out_buf[BF_IO_OUTPUT_BUFFER_SIZE];
+    unsigned char in_buf[BF_IO_INPUT_BUFFER_SIZE];
+};
+
+// I/O functions. bf_io_init streams from and to descriptors and exits on
+// errors like the command line tool; bf_io_init_callbacks never exits, a
+// failed write drops the output and a failed read counts as EOF.
+void bf_io_init(bf_io_t *io, int in_fd, int out_fd, bf_eof_mode_t eof_mode);
+void bf_io_init_callbacks(bf_io_t *io, const bf_io_callbacks_t *callbacks, bf_eof_mode_t eof_mode);
+void bf_io_flush(bf_io_t *io);
+int bf_io_refill(bf_io_t *io);
+void bf_io_write(bf_io_t *io, const void *data, size_t size);
+size_t bf_io_bytes_read(const bf_io_t *io);
+
+// Zero-copy descriptor I/O, for bf_io_init state. map_input maps a
+// regular in_fd whole and points the input cursors at it, so ',' reads
+// the page cache directly and the first refill is EOF. pipe_output, on
+// Linux and when out_fd is a pipe, fills page-aligned halves the size of
+// the pipe and hands full ones to it with vmsplice instead of copying:
+// a half is refilled only after the other one has passed through the
+// whole pipe, so the reader must copy the data out (read it) rather than
+// splice it on. Mapped input counts as read as the cursor passes it. Both return 0, or -1 (nothing changed) when they do not
+// apply; release undoes them.
+int bf_io_map_input(bf_io_t *io);
+int bf_io_pipe_output(bf_io_t *io);
+void bf_io_release(bf_io_t *io);
+
+#endif // BF_IO_H
@@ -0,0 +1,147 @@
+#include "bf_lib.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "bf_codegen.h"
+#include "bf_ast.h"
+#include "bf_peval.h"
+#include "bf_scan.h"
+
+struct bf_program {
+    bf_func code;
+    void *code_ptr;
+    size_t code_size;
+    bf_eof_mode_t eof_mode;
+    size_t memory_size;
+    size_t memory_offset;
+};
+
+static void set_error(char *error, size_t error_size, const char *msg) {
+    if (error && error_size > 0) {
+        snprintf(error, error_size, "%s", msg);
+    }
+}
+
+void bf_options_init(bf_options_t *options) {
+    options->optimize = true;
+    options->unsafe_mode = false;
+    options->eof_mode = BF_EOF_ZERO;
+    options->memory_size = BF_DEFAULT_MEMORY_SIZE;
+    options->memory_offset = BF_DEFAULT_MEMORY_OFFSET;
+    options->peval_steps = BF_PEVAL_DEFAULT_STEPS;
+}
+
+bf_program_t *bf_compile(const char *source, const bf_options_t *options, char *error, size_t error_size) {
+    bf_options_t defaults;
+    if (!options) {
+        bf_options_init(&defaults);
+        options = &defaults;
+    }
+    if (options->memory_offset >= options->memory_size) {
+        set_error(error, error_size, "Memory offset must be less than memory size");
+        return NULL;
+    }
+
+    ast_node_t *ast;
+    if (bf_scan(source, strlen(source), options->optimize, &ast, error, error_size) != 0) {
+        ast_arena_reset();
+        return NULL;
+    }
+
+    // Same pipeline as the command line tool: all passes, then partial
+    // evaluation of the input-independent prefix
+    size_t effective_memory_size = tape_size_pow2(options->memory_size - options->memory_offset);
+    bf_peval_t prelude;
+    const bf_peval_t *prelude_ptr = NULL;
+    memset(&prelude, 0, sizeof(prelude));
+
+    if (options->optimize) {
+        const ast_pass_t *passes[ast_pass_count];
+        for (int p = 0; p < ast_pass_count; p++) {
+            passes[p] = &ast_passes[p];
+        }
+        ast_set_tape_wrap(options->unsafe_mode ? 0 : effective_memory_size);
+        ast = ast_arena_compact(ast_run_passes(ast, passes, ast_pass_count, NULL));
+
+        if (options->peval_steps > 0) {
+            bool unsafe_mode = options->unsafe_mode;
+            bf_peval_run(&prelude, ast, options->peval_steps,
+                         unsafe_mode ? options->memory_size : effective_memory_size,
+                         unsafe_mode ? options->memory_offset : 0, !unsafe_mode);
+            if (prelude.residual != ast) {
+                ast = prelude.residual ? ast_arena_compact(prelude.residual) : NULL;
+                prelude_ptr = &prelude;
+            }
+        }
+    }
+
+    bf_program_t *program = calloc(1, sizeof(bf_program_t));
+    if (!program) {
+        set_error(error, error_size, "Memory allocation failed");
+        bf_peval_free(&prelude);
+        ast_arena_reset();
+        return NULL;
+    }
+
+    bf_codegen_options_t codegen = {
+        .unsafe_mode = options->unsafe_mode,
+        .eof_mode = options->eof_mode,
+        .memory_size = effective_memory_size,
+        .prelude = prelude_ptr,
+    };
+    program->code = bf_codegen_compile(ast, &codegen, &program->code_ptr, &program->code_size);
+    program->eof_mode = options->eof_mode;
+    program->memory_size = options->memory_size;
+    program->memory_offset = options->memory_offset;
+
+    // The code is self-contained: nothing it runs refers to the tree
+    bf_peval_free(&prelude);
+    ast_arena_reset();
+
+    if (!program->code) {
+        set_error(error, error_size, "JIT compilation failed");
+        free(program);
+        return NULL;
+    }
+    return program;
+}
+
+void bf_program_free(bf_program_t *program) {
+    if (!program) return;
+    bf_codegen_free(program->code_ptr, program->code_size);
+    free(program);
+}
+
+size_t bf_program_tape_size(const bf_program_t *program) {
+    return program->memory_size;
+}
+
+int bf_run(const bf_program_t *program, char *tape, const bf_io_callbacks_t *callbacks) {
+    char *memory = tape ? tape : allocate_guarded_memory(program->memory_size);
+    bf_io_t *io = malloc(sizeof(bf_io_t));
+    if (!memory || !io) {
+        if (!tape) free_guarded_memory(memory, program->memory_size);
+        free(io);
+        return -1;
+    }
+
+    if (callbacks) {
+        bf_io_init_callbacks(io, callbacks, program->eof_mode);
+    } else {
+        bf_io_init(io, STDIN_FILENO, STDOUT_FILENO, program->eof_mode);
+        io->exit_on_error = false;
+    }
+    io->debug_log = bf_codegen_debug_log;
+
+    program->code(memory + program->memory_offset, io);
+    bf_io_flush(io);
+
+    int ret = io->error ? -1 : 0;
+    free(io);
+    if (!tape) {
+        free_guarded_memory(memory, program->memory_size);
+    }
+    return ret;
+}
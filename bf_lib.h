@@ -0,0 +1,42 @@
+#ifndef BF_LIB_H
+#define BF_LIB_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "bf_io.h"
+
+#define BF_DEFAULT_MEMORY_SIZE 65536  // 64KB - nice power of 2
+#define BF_DEFAULT_MEMORY_OFFSET 4096 // Room for negative access
+
+// Embedding API: compile a program once, then run it any number of times.
+// Compiled programs are immutable and every run gets its own I/O state, so
+// one program can run on several threads at once, and separate programs
+// can be compiled on separate threads.
+typedef struct {
+    bool optimize;              // Run the AST passes and partial evaluation
+    bool unsafe_mode;           // No tape masking (see --unsafe)
+    bf_eof_mode_t eof_mode;     // What ',' stores at EOF
+    size_t memory_size;         // Tape size in bytes
+    size_t memory_offset;       // Initial cell, from the start of the tape
+    long peval_steps;           // Partial evaluation budget, 0 disables
+} bf_options_t;
+
+typedef struct bf_program bf_program_t;
+
+// Defaults match the command line tool without flags
+void bf_options_init(bf_options_t *options);
+
+// Compile source; options may be NULL for the defaults. Returns NULL on
+// failure with the reason in error (if not NULL).
+bf_program_t *bf_compile(const char *source, const bf_options_t *options, char *error, size_t error_size);
+void bf_program_free(bf_program_t *program);
+
+// Run program once. tape is NULL for a fresh zeroed tape with guard pages,
+// or caller memory of bf_program_tape_size() bytes whose contents carry
+// over between runs (without guard pages, so only in safe mode). io is
+// NULL for stdin/stdout. Returns 0, or -1 if the run could not be set up
+// or a read or write failed.
+int bf_run(const bf_program_t *program, char *tape, const bf_io_callbacks_t *io);
+size_t bf_program_tape_size(const bf_program_t *program);
+
+#endif // BF_LIB_H
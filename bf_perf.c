@@ -0,0 +1,424 @@
+#define _GNU_SOURCE
+#include "bf_perf.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <ctype.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#if defined(__linux__)
+#include <elf.h>
+#include <sys/syscall.h>
+#endif
+
+// Which symbol a node's code belongs to: the node itself for loops, scans
+// and hot nodes, otherwise its innermost enclosing loop (NULL at top level)
+typedef struct {
+    const ast_node_t *node;
+    const ast_node_t *owner;
+} owner_ref_t;
+
+static int compare_owner_ref(const void *a, const void *b) {
+    uintptr_t x = (uintptr_t)((const owner_ref_t *)a)->node;
+    uintptr_t y = (uintptr_t)((const owner_ref_t *)b)->node;
+    return (x > y) - (x < y);
+}
+
+static bool names_loop(ast_node_type_t type) {
+    return type == AST_LOOP || type == AST_IF || type == AST_SCAN;
+}
+
+static int collect_owners(const ast_node_t *node, const ast_node_t *loop, long hot_samples, owner_ref_t *refs, int n) {
+    for (; node; node = node->next) {
+        bool hot = hot_samples > 0 && node->profile_samples >= hot_samples;
+        refs[n].node = node;
+        refs[n].owner = names_loop(node->type) || hot ? node : loop;
+        n++;
+        if (ast_has_body(node)) {
+            n = collect_owners(node->data.loop.body, node, hot_samples, refs, n);
+        }
+    }
+    return n;
+}
+
+static long total_samples(const ast_node_t *node) {
+    long total = 0;
+    for (; node; node = node->next) {
+        total += node->profile_samples;
+        if (ast_has_body(node)) total += total_samples(node->data.loop.body);
+    }
+    return total;
+}
+
+static void format_name(char *buf, size_t size, ast_node_type_t type, int line, int column) {
+    char kind[16];
+    const char *name = debug_node_type_name(type);
+    size_t i = 0;
+    for (; name[i] && i < sizeof(kind) - 1; i++) kind[i] = (char)tolower((unsigned char)name[i]);
+    kind[i] = '\0';
+    snprintf(buf, size, "%s@%d:%d", kind, line, column);
+}
+
+static void add_symbol(bf_symbols_t *syms, int *capacity, size_t start, size_t end, const char *name) {
+    if (end <= start) return;
+
+    bf_symbol_t *last = syms->count > 0 ? &syms->symbols[syms->count - 1] : NULL;
+    if (last && last->start + last->size == start && strcmp(last->name, name) == 0) {
+        last->size += end - start;
+        return;
+    }
+
+    if (syms->count == *capacity) {
+        *capacity = *capacity ? *capacity * 2 : 64;
+        bf_symbol_t *grown = realloc(syms->symbols, (size_t)*capacity * sizeof(bf_symbol_t));
+        if (!grown) {
+            perror("realloc");
+            exit(1);
+        }
+        syms->symbols = grown;
+    }
+    bf_symbol_t *sym = &syms->symbols[syms->count++];
+    sym->start = start;
+    sym->size = end - start;
+    snprintf(sym->name, sizeof(sym->name), "%s", name);
+}
+
+int bf_symbols_build(bf_symbols_t *syms, const bf_debug_info_t *debug, ast_node_t *ast) {
+    memset(syms, 0, sizeof(*syms));
+    syms->code_start = debug->code_start;
+    syms->code_size = debug->code_size;
+
+    owner_ref_t *refs = NULL;
+    int ref_count = 0;
+    if (ast) {
+        long total = total_samples(ast);
+        long hot_samples = total > 0 ? (total + BF_PERF_HOT_SHARE - 1) / BF_PERF_HOT_SHARE : 0;
+        refs = malloc((size_t)ast_count_nodes(ast) * sizeof(owner_ref_t));
+        if (!refs) return -1;
+        ref_count = collect_owners(ast, NULL, hot_samples, refs, 0);
+        qsort(refs, (size_t)ref_count, sizeof(owner_ref_t), compare_owner_ref);
+    }
+
+    int capacity = 0;
+    add_symbol(syms, &capacity, 0, bf_debug_region_end(debug, 0), "bf_prologue");
+
+    // The epilogue and cold section sit between and after the entries, in
+    // address order
+    bool exit_done = debug->exit_offset == 0;
+    for (int i = 0; i < debug->entry_count; i++) {
+        const debug_map_entry_t *entry = &debug->entries[i];
+        size_t end = bf_debug_entry_end(debug, i);
+        char name[48] = "bf_main";
+
+        if (!exit_done && entry->pc_offset > debug->exit_offset) {
+            add_symbol(syms, &capacity, debug->exit_offset, bf_debug_region_end(debug, debug->exit_offset), "bf_epilogue");
+            exit_done = true;
+        }
+
+        const owner_ref_t *ref = NULL;
+        if (entry->node && refs) {
+            owner_ref_t key = { entry->node, NULL };
+            ref = bsearch(&key, refs, (size_t)ref_count, sizeof(owner_ref_t), compare_owner_ref);
+        }
+        if (ref) {
+            if (ref->owner) format_name(name, sizeof(name), ref->owner->type, ref->owner->line, ref->owner->column);
+        } else if (names_loop(entry->node_type)) {
+            format_name(name, sizeof(name), entry->node_type, entry->source_line, entry->source_column);
+        }
+        add_symbol(syms, &capacity, entry->pc_offset, end, name);
+    }
+    if (!exit_done) {
+        add_symbol(syms, &capacity, debug->exit_offset, bf_debug_region_end(debug, debug->exit_offset), "bf_epilogue");
+    }
+    if (debug->cold_offset > 0 && debug->cold_offset < debug->code_size) {
+        add_symbol(syms, &capacity, debug->cold_offset, debug->code_size, "bf_cold");
+    }
+
+    free(refs);
+    return 0;
+}
+
+void bf_symbols_free(bf_symbols_t *syms) {
+    free(syms->symbols);
+    memset(syms, 0, sizeof(*syms));
+}
+
+int bf_perf_write_map(const bf_symbols_t *syms) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/perf-%ld.map", (long)getpid());
+
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+
+    int ret = 0;
+    for (int i = 0; i < syms->count && ret == 0; i++) {
+        const bf_symbol_t *sym = &syms->symbols[i];
+        uintptr_t start = (uintptr_t)syms->code_start + sym->start;
+        if (fprintf(out, "%llx %zx %s\n", (unsigned long long)start, sym->size, sym->name) < 0) ret = -1;
+    }
+    if (fclose(out) != 0) ret = -1;
+    return ret;
+}
+
+#if defined(__linux__)
+
+#if defined(__x86_64__)
+#define BF_ELF_MACHINE EM_X86_64
+#elif defined(__aarch64__)
+#define BF_ELF_MACHINE EM_AARCH64
+#else
+#define BF_ELF_MACHINE EM_NONE
+#endif
+
+// jitdump format, see tools/perf/Documentation/jitdump-specification.txt
+#define JITDUMP_MAGIC 0x4A695444
+#define JITDUMP_VERSION 1
+#define JIT_CODE_LOAD 0
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} jitdump_header_t;
+
+typedef struct {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+} jitdump_code_load_t;
+
+// perf record -k mono matches samples to records by CLOCK_MONOTONIC
+static uint64_t jitdump_timestamp(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+static int write_all(int fd, const void *data, size_t size) {
+    const char *p = data;
+    while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n <= 0) return -1;
+        p += n;
+        size -= (size_t)n;
+    }
+    return 0;
+}
+
+int bf_perf_write_jitdump(const bf_symbols_t *syms) {
+    const char *dir = getenv("JITDUMPDIR");
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/jit-%ld.dump", dir && *dir ? dir : "/tmp", (long)getpid());
+
+    int fd = open(path, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0) return -1;
+
+    // perf finds the dump through this executable mapping in the trace
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    void *marker = mmap(NULL, page, PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    if (marker == MAP_FAILED) {
+        close(fd);
+        return -1;
+    }
+
+    jitdump_header_t header = {
+        .magic = JITDUMP_MAGIC,
+        .version = JITDUMP_VERSION,
+        .total_size = sizeof(jitdump_header_t),
+        .elf_mach = BF_ELF_MACHINE,
+        .pid = (uint32_t)getpid(),
+        .timestamp = jitdump_timestamp(),
+    };
+    int ret = write_all(fd, &header, sizeof(header));
+
+    uint32_t tid = (uint32_t)syscall(SYS_gettid);
+    for (int i = 0; i < syms->count && ret == 0; i++) {
+        const bf_symbol_t *sym = &syms->symbols[i];
+        size_t name_size = strlen(sym->name) + 1;
+        uint64_t addr = (uint64_t)(uintptr_t)syms->code_start + sym->start;
+        jitdump_code_load_t record = {
+            .id = JIT_CODE_LOAD,
+            .total_size = (uint32_t)(sizeof(record) + name_size + sym->size),
+            .timestamp = jitdump_timestamp(),
+            .pid = header.pid,
+            .tid = tid,
+            .vma = addr,
+            .code_addr = addr,
+            .code_size = sym->size,
+            .code_index = (uint64_t)i,
+        };
+        ret = write_all(fd, &record, sizeof(record));
+        if (ret == 0) ret = write_all(fd, sym->name, name_size);
+        if (ret == 0) ret = write_all(fd, (const char *)syms->code_start + sym->start, sym->size);
+    }
+
+    // The marker mapping stays for the life of the process
+    if (close(fd) != 0) ret = -1;
+    return ret;
+}
+
+// GDB JIT interface: GDB sets a breakpoint in __jit_debug_register_code
+// and reads the object files listed in __jit_debug_descriptor. The names
+// and layout are fixed by GDB.
+typedef enum {
+    JIT_NOACTION = 0,
+    JIT_REGISTER_FN,
+    JIT_UNREGISTER_FN
+} jit_actions_t;
+
+struct jit_code_entry {
+    struct jit_code_entry *next_entry;
+    struct jit_code_entry *prev_entry;
+    const char *symfile_addr;
+    uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+    uint32_t version;
+    uint32_t action_flag;
+    struct jit_code_entry *relevant_entry;
+    struct jit_code_entry *first_entry;
+};
+
+void __attribute__((noinline)) __jit_debug_register_code(void);
+void __attribute__((noinline)) __jit_debug_register_code(void) {
+    __asm__ __volatile__("");
+}
+
+struct jit_descriptor __jit_debug_descriptor = { 1, JIT_NOACTION, NULL, NULL };
+
+static struct jit_code_entry *g_gdb_entry = NULL;
+
+// Relocatable ELF with a NOBITS .text placed at the code address and one
+// function symbol per range; GDB needs no section contents for symbols
+enum { SEC_NULL, SEC_TEXT, SEC_SYMTAB, SEC_STRTAB, SEC_SHSTRTAB, SEC_COUNT };
+
+static const char gdb_shstrtab[] = "\0.text\0.symtab\0.strtab\0.shstrtab";
+
+int bf_gdb_register(const bf_symbols_t *syms) {
+    if (g_gdb_entry) bf_gdb_unregister();
+
+    size_t strtab_size = 1;
+    for (int i = 0; i < syms->count; i++) strtab_size += strlen(syms->symbols[i].name) + 1;
+
+    size_t symtab_offset = sizeof(Elf64_Ehdr) + SEC_COUNT * sizeof(Elf64_Shdr);
+    size_t symtab_size = (size_t)(syms->count + 1) * sizeof(Elf64_Sym);
+    size_t strtab_offset = symtab_offset + symtab_size;
+    size_t shstrtab_offset = strtab_offset + strtab_size;
+    size_t total = shstrtab_offset + sizeof(gdb_shstrtab);
+
+    char *elf = calloc(1, total);
+    struct jit_code_entry *entry = calloc(1, sizeof(*entry));
+    if (!elf || !entry) {
+        free(elf);
+        free(entry);
+        return -1;
+    }
+
+    Elf64_Ehdr *ehdr = (Elf64_Ehdr *)elf;
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_type = ET_REL;
+    ehdr->e_machine = BF_ELF_MACHINE;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_shoff = sizeof(Elf64_Ehdr);
+    ehdr->e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr->e_shentsize = sizeof(Elf64_Shdr);
+    ehdr->e_shnum = SEC_COUNT;
+    ehdr->e_shstrndx = SEC_SHSTRTAB;
+
+    Elf64_Shdr *shdr = (Elf64_Shdr *)(elf + sizeof(Elf64_Ehdr));
+    shdr[SEC_TEXT] = (Elf64_Shdr){
+        .sh_name = 1, .sh_type = SHT_NOBITS, .sh_flags = SHF_ALLOC | SHF_EXECINSTR,
+        .sh_addr = (Elf64_Addr)(uintptr_t)syms->code_start, .sh_size = syms->code_size, .sh_addralign = 16,
+    };
+    shdr[SEC_SYMTAB] = (Elf64_Shdr){
+        .sh_name = 7, .sh_type = SHT_SYMTAB, .sh_offset = symtab_offset, .sh_size = symtab_size,
+        .sh_link = SEC_STRTAB, .sh_info = 1, .sh_addralign = 8, .sh_entsize = sizeof(Elf64_Sym),
+    };
+    shdr[SEC_STRTAB] = (Elf64_Shdr){
+        .sh_name = 15, .sh_type = SHT_STRTAB, .sh_offset = strtab_offset, .sh_size = strtab_size, .sh_addralign = 1,
+    };
+    shdr[SEC_SHSTRTAB] = (Elf64_Shdr){
+        .sh_name = 23, .sh_type = SHT_STRTAB, .sh_offset = shstrtab_offset, .sh_size = sizeof(gdb_shstrtab), .sh_addralign = 1,
+    };
+
+    Elf64_Sym *sym = (Elf64_Sym *)(elf + symtab_offset) + 1;
+    char *strtab = elf + strtab_offset;
+    size_t name_offset = 1;
+    for (int i = 0; i < syms->count; i++, sym++) {
+        size_t len = strlen(syms->symbols[i].name) + 1;
+        memcpy(strtab + name_offset, syms->symbols[i].name, len);
+        sym->st_name = (Elf64_Word)name_offset;
+        sym->st_info = ELF64_ST_INFO(STB_GLOBAL, STT_FUNC);
+        sym->st_shndx = SEC_TEXT;
+        sym->st_value = syms->symbols[i].start;  // Section-relative in ET_REL
+        sym->st_size = syms->symbols[i].size;
+        name_offset += len;
+    }
+    memcpy(elf + shstrtab_offset, gdb_shstrtab, sizeof(gdb_shstrtab));
+
+    entry->symfile_addr = elf;
+    entry->symfile_size = total;
+    entry->next_entry = __jit_debug_descriptor.first_entry;
+    if (entry->next_entry) entry->next_entry->prev_entry = entry;
+    __jit_debug_descriptor.first_entry = entry;
+    __jit_debug_descriptor.relevant_entry = entry;
+    __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+    __jit_debug_register_code();
+
+    g_gdb_entry = entry;
+    return 0;
+}
+
+void bf_gdb_unregister(void) {
+    struct jit_code_entry *entry = g_gdb_entry;
+    if (!entry) return;
+
+    if (entry->prev_entry) {
+        entry->prev_entry->next_entry = entry->next_entry;
+    } else {
+        __jit_debug_descriptor.first_entry = entry->next_entry;
+    }
+    if (entry->next_entry) entry->next_entry->prev_entry = entry->prev_entry;
+    __jit_debug_descriptor.relevant_entry = entry;
+    __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+    __jit_debug_register_code();
+
+    free((void *)entry->symfile_addr);
+    free(entry);
+    g_gdb_entry = NULL;
+}
+
+#else
+
+int bf_perf_write_jitdump(const bf_symbols_t *syms) {
+    (void)syms;
+    return -1;
+}
+
+int bf_gdb_register(const bf_symbols_t *syms) {
+    (void)syms;
+    return -1;
+}
+
+void bf_gdb_unregister(void) {
+}
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef BF_PERF_H
+#define BF_PERF_H
+
+#include <stddef.h>
+#include "bf_ast.h"
+#include "bf_debug.h"
+
+// A node is named on its own when it took at least 1/BF_PERF_HOT_SHARE
+// of the samples in a --pgo-in profile
+#define BF_PERF_HOT_SHARE 100
+
+// JIT code described as named, non-overlapping ranges for external tools:
+// loops and scans are "loop@12:5" / "scan@3:1", code outside any loop is
+// "bf_main", and hot nodes get their own symbol such as "mul@14:9". The
+// fixed parts are "bf_prologue", "bf_epilogue" and "bf_cold" (slow paths,
+// amd64 only).
+typedef struct {
+    size_t start;               // Offset from the start of the code
+    size_t size;
+    char name[48];
+} bf_symbol_t;
+
+typedef struct {
+    bf_symbol_t *symbols;       // Sorted by start
+    int count;
+    void *code_start;
+    size_t code_size;
+} bf_symbols_t;
+
+// Symbol table functions. ast may be NULL (code from the cache): debug
+// entries without a node are then named from their own type and location.
+int bf_symbols_build(bf_symbols_t *syms, const bf_debug_info_t *debug, ast_node_t *ast);
+void bf_symbols_free(bf_symbols_t *syms);
+
+// Writers for Linux perf: /tmp/perf-<pid>.map, or a jitdump file in
+// $JITDUMPDIR (default /tmp) for `perf inject --jit`. 0 on success.
+int bf_perf_write_map(const bf_symbols_t *syms);
+int bf_perf_write_jitdump(const bf_symbols_t *syms);
+
+// GDB JIT interface (__jit_debug_register_code): publish the symbols as an
+// in-memory ELF object so backtraces and disassembly show them by name
+int bf_gdb_register(const bf_symbols_t *syms);
+void bf_gdb_unregister(void);
+
+#endif // BF_PERF_H
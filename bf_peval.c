@@ -0,0 +1,204 @@
+#include "bf_peval.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Compile-time interpreter for the prefix of a program that does not
+// depend on input. It stops before the first node it cannot run
+// (`,`, `#`, a tape access out of bounds, a full output buffer or an
+// exhausted step budget) and never executes a node halfway, so the
+// residual program is exactly the continuation from that node.
+typedef struct {
+    unsigned char *tape;
+    size_t tape_size;
+    bool wrap;                  // Safe mode: indices wrap modulo tape_size
+    long ptr;                   // Current cell index into tape
+    long lo, hi;                // Range of cells written so far
+    bool written;
+    unsigned char *output;
+    size_t output_size;
+    long steps, max_steps;
+} peval_state_t;
+
+// Tape index of the cell at offset, or false if it is outside the tape
+static bool peval_index(peval_state_t *st, int offset, long *index) {
+    long i = st->ptr + offset;
+    if (st->wrap) {
+        *index = i & (long)(st->tape_size - 1);
+        return true;
+    }
+    if (i < 0 || (size_t)i >= st->tape_size) return false;
+    *index = i;
+    return true;
+}
+
+static bool peval_step(peval_state_t *st) {
+    return st->steps++ < st->max_steps;
+}
+
+static void peval_store(peval_state_t *st, long index, int value) {
+    st->tape[index] = (unsigned char)value;
+    if (!st->written) {
+        st->lo = st->hi = index;
+        st->written = true;
+    }
+    if (index < st->lo) st->lo = index;
+    if (index > st->hi) st->hi = index;
+}
+
+// Run one straight-line node; false without side effects if it can't be
+static bool peval_node(peval_state_t *st, ast_node_t *node) {
+    long a, b, c;
+
+    switch (node->type) {
+        case AST_MOVE_PTR:
+            if (!peval_step(st)) return false;
+            st->ptr += node->data.basic.count;
+            if (st->wrap) st->ptr &= (long)(st->tape_size - 1);
+            return true;
+
+        case AST_ADD_VAL:
+            if (!peval_index(st, node->data.basic.offset, &a) || !peval_step(st)) return false;
+            peval_store(st, a, st->tape[a] + node->data.basic.count);
+            return true;
+
+        case AST_SET_CONST:
+            if (!peval_index(st, node->data.basic.offset, &a) || !peval_step(st)) return false;
+            peval_store(st, a, node->data.basic.count);
+            return true;
+
+        case AST_OUTPUT:
+            if (st->output_size == BF_PEVAL_MAX_OUTPUT) return false;
+            if (!peval_index(st, node->data.basic.offset, &a) || !peval_step(st)) return false;
+            st->output[st->output_size++] = st->tape[a];
+            return true;
+
+        case AST_MUL:
+            if (!peval_index(st, node->data.mul.src_offset, &a) ||
+                !peval_index(st, node->data.mul.dst_offset, &b) || !peval_step(st)) return false;
+            peval_store(st, b, st->tape[b] + st->tape[a] * node->data.mul.multiplier);
+            return true;
+
+        case AST_MUL2:
+            if (!peval_index(st, node->data.mul.src_offset, &a) ||
+                !peval_index(st, node->data.mul.src2_offset, &c) ||
+                !peval_index(st, node->data.mul.dst_offset, &b) || !peval_step(st)) return false;
+            peval_store(st, b, st->tape[b] + st->tape[a] * st->tape[c] * node->data.mul.multiplier);
+            return true;
+
+        default:
+            // Input and debug hooks happen at run time
+            return false;
+    }
+}
+
+static ast_node_t *peval_append(ast_node_t *list, ast_node_t *tail) {
+    if (!list) return tail;
+    ast_node_t *last = list;
+    while (last->next) last = last->next;
+    last->next = tail;
+    return list;
+}
+
+// Run a sibling list. Returns NULL if it ran to the end, otherwise sets
+// *stopped and returns a fresh copy of what is left of the list
+static ast_node_t *peval_list(peval_state_t *st, ast_node_t *node, bool *stopped) {
+    long index;
+
+    for (; node; node = node->next) {
+        switch (node->type) {
+            case AST_LOOP:
+            case AST_IF:
+                for (;;) {
+                    if (!peval_index(st, 0, &index) || !peval_step(st)) goto stop;
+                    if (st->tape[index] == 0) break;
+
+                    ast_node_t *rest = peval_list(st, node->data.loop.body, stopped);
+                    if (*stopped) {
+                        // Finish this iteration, then re-test the loop (an
+                        // IF is done) and carry on with the list
+                        ast_node_t *tail = ast_clone(node->type == AST_LOOP ? node : node->next);
+                        return peval_append(rest, tail);
+                    }
+                    if (node->type == AST_IF) break;
+                }
+                break;
+
+            case AST_SCAN:
+                for (;;) {
+                    if (!peval_index(st, 0, &index) || !peval_step(st)) goto stop;
+                    if (st->tape[index] == 0) break;
+                    st->ptr += node->data.basic.count;
+                    if (st->wrap) st->ptr &= (long)(st->tape_size - 1);
+                }
+                break;
+
+            default:
+                if (!peval_node(st, node)) goto stop;
+                break;
+        }
+    }
+    return NULL;
+
+stop:
+    *stopped = true;
+    return ast_clone(node);
+}
+
+void bf_peval_run(bf_peval_t *pe, ast_node_t *ast, long max_steps, size_t tape_size, size_t origin, bool wrap) {
+    peval_state_t st;
+    size_t array_size = (tape_size + 7) & ~(size_t)7;
+
+    memset(pe, 0, sizeof(*pe));
+    memset(&st, 0, sizeof(st));
+    st.tape = calloc(array_size, 1);
+    st.output = malloc(BF_PEVAL_MAX_OUTPUT);
+    if (!st.tape || !st.output) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(1);
+    }
+    st.tape_size = tape_size;
+    st.wrap = wrap;
+    st.ptr = (long)origin;
+    st.max_steps = max_steps;
+
+    bool stopped = false;
+    ast_node_t *residual = peval_list(&st, ast, &stopped);
+
+    pe->steps = st.steps;
+    pe->tape = st.tape;
+    pe->output = st.output;
+    pe->output_size = st.output_size;
+    pe->complete = !stopped;
+
+    if (stopped && !st.written && st.output_size == 0 && st.ptr == (long)origin) {
+        // Nothing observable happened: run the program as it is
+        pe->residual = ast;
+        return;
+    }
+
+    if (st.written) {
+        long start = st.lo & ~7L;
+        long end = (st.hi + 8) & ~7L;
+        if ((size_t)end > array_size) end = (long)array_size;
+        pe->image = st.tape + start;
+        pe->image_start = start - (long)origin;
+        pe->image_size = (size_t)(end - start);
+    }
+
+    if (stopped) {
+        long move = st.ptr - (long)origin;
+        if (move != 0) {
+            ast_node_t *node = ast_create_move((int)move);
+            ast_copy_location(node, residual);
+            residual = peval_append(node, residual);
+        }
+        pe->residual = residual;
+    }
+}
+
+void bf_peval_free(bf_peval_t *pe) {
+    free(pe->tape);
+    free(pe->output);
+    memset(pe, 0, sizeof(*pe));
+}
@@ -0,0 +1,32 @@
+#ifndef BF_PEVAL_H
+#define BF_PEVAL_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+
+#define BF_PEVAL_DEFAULT_STEPS 10000000     // Node executions before giving up
+#define BF_PEVAL_MAX_OUTPUT (1 << 20)       // Output bytes folded into the code
+
+// Result of running the input-independent prefix of a program at compile
+// time: the tape and output it produced, and the program left to run from
+// there. The JIT writes the image and output in a prelude, then resumes.
+typedef struct {
+    unsigned char *image;       // Tape cells starting at image_start
+    long image_start;           // Offset of image[0] from the initial cell, 8-byte aligned
+    size_t image_size;
+    unsigned char *output;      // Everything printed by the prefix
+    size_t output_size;
+    long steps;                 // Node executions spent
+    bool complete;              // Ran to the end: there is no residual program
+    ast_node_t *residual;       // Program to compile, pointer move to the stop point first
+    unsigned char *tape;        // Backing store for image
+} bf_peval_t;
+
+// Partial evaluator functions. tape_size cells are addressable; the
+// program starts at cell origin. In safe mode (wrap) offsets wrap around
+// the tape, otherwise an access outside it ends the evaluation.
+void bf_peval_run(bf_peval_t *pe, ast_node_t *ast, long max_steps, size_t tape_size, size_t origin, bool wrap);
+void bf_peval_free(bf_peval_t *pe);
+
+#endif // BF_PEVAL_H
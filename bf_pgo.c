@@ -0,0 +1,169 @@
+#include "bf_pgo.h"
+#include "bf_debug.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Profile file format, one record per line after the header:
+//   line column TYPE samples entries iterations
+// Lines starting with '#' are comments.
+#define BF_PGO_HEADER "# bf-pgo 1"
+
+#define FNV_OFFSET_BASIS 0xcbf29ce484222325ULL
+#define FNV_PRIME 0x100000001b3ULL
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const unsigned char *p = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+static int compare_entry(const void *a, const void *b) {
+    const bf_pgo_entry_t *x = a;
+    const bf_pgo_entry_t *y = b;
+    if (x->line != y->line) return (x->line > y->line) - (x->line < y->line);
+    if (x->column != y->column) return (x->column > y->column) - (x->column < y->column);
+    return ((int)x->type > (int)y->type) - ((int)x->type < (int)y->type);
+}
+
+static bool parse_type(const char *name, ast_node_type_t *type) {
+    for (int t = AST_MOVE_PTR; t <= AST_IF; t++) {
+        if (strcmp(name, debug_node_type_name((ast_node_type_t)t)) == 0) {
+            *type = (ast_node_type_t)t;
+            return true;
+        }
+    }
+    return false;
+}
+
+int bf_pgo_load(bf_pgo_t *pgo, const char *path) {
+    memset(pgo, 0, sizeof(*pgo));
+
+    FILE *file = fopen(path, "r");
+    if (!file) return -1;
+
+    char line[256];
+    int capacity = 0;
+    bool header = false;
+    uint64_t hash = FNV_OFFSET_BASIS;
+
+    while (fgets(line, sizeof(line), file)) {
+        hash = fnv1a(hash, line, strlen(line));
+        if (!header) {
+            if (strncmp(line, BF_PGO_HEADER, strlen(BF_PGO_HEADER)) != 0) break;
+            header = true;
+            continue;
+        }
+        if (line[0] == '#' || line[0] == '\n') continue;
+
+        bf_pgo_entry_t entry;
+        char type[64];
+        unsigned long long samples, entries, iterations;
+        if (sscanf(line, "%d %d %63s %llu %llu %llu", &entry.line, &entry.column, type,
+                   &samples, &entries, &iterations) != 6 || !parse_type(type, &entry.type)) {
+            header = false;
+            break;
+        }
+        entry.samples = samples;
+        entry.entries = entries;
+        entry.iterations = iterations;
+
+        if (pgo->entry_count == capacity) {
+            capacity = capacity ? capacity * 2 : 256;
+            bf_pgo_entry_t *grown = realloc(pgo->entries, (size_t)capacity * sizeof(bf_pgo_entry_t));
+            if (!grown) {
+                perror("realloc");
+                exit(1);
+            }
+            pgo->entries = grown;
+        }
+        pgo->entries[pgo->entry_count++] = entry;
+    }
+    fclose(file);
+
+    if (!header) {
+        bf_pgo_free(pgo);
+        return -1;
+    }
+
+    // Nodes that share a location (e.g. a loop and the guard an optimization
+    // wrapped around it) are merged into one record
+    qsort(pgo->entries, (size_t)pgo->entry_count, sizeof(bf_pgo_entry_t), compare_entry);
+    int n = 0;
+    for (int i = 0; i < pgo->entry_count; i++) {
+        bf_pgo_entry_t *entry = &pgo->entries[i];
+        if (n > 0 && compare_entry(&pgo->entries[n - 1], entry) == 0) {
+            pgo->entries[n - 1].samples += entry->samples;
+            pgo->entries[n - 1].entries += entry->entries;
+            pgo->entries[n - 1].iterations += entry->iterations;
+        } else {
+            pgo->entries[n++] = *entry;
+        }
+        pgo->total_iterations += entry->iterations;
+    }
+    pgo->entry_count = n;
+    pgo->hash = hash;
+    return 0;
+}
+
+static int write_nodes(ast_node_t *node, FILE *out) {
+    for (; node; node = node->next) {
+        bool counted = node->type == AST_LOOP || node->type == AST_IF;
+        if (counted || node->profile_samples > 0) {
+            if (fprintf(out, "%d %d %s %d %llu %llu\n", node->line, node->column,
+                        debug_node_type_name(node->type), node->profile_samples,
+                        (unsigned long long)node->profile_entries,
+                        (unsigned long long)node->profile_iterations) < 0) {
+                return -1;
+            }
+        }
+        if (ast_has_body(node) && write_nodes(node->data.loop.body, out) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int bf_pgo_write(ast_node_t *ast, const char *path) {
+    FILE *out = fopen(path, "w");
+    if (!out) return -1;
+
+    int ret = fprintf(out, "%s\n# line column type samples entries iterations\n", BF_PGO_HEADER) < 0 ? -1 : 0;
+    if (ret == 0) ret = write_nodes(ast, out);
+    if (fclose(out) != 0) ret = -1;
+    return ret;
+}
+
+void bf_pgo_annotate(const bf_pgo_t *pgo, ast_node_t *ast) {
+    for (ast_node_t *node = ast; node; node = node->next) {
+        bf_pgo_entry_t key = { .line = node->line, .column = node->column, .type = node->type };
+        const bf_pgo_entry_t *entry = bsearch(&key, pgo->entries, (size_t)pgo->entry_count,
+                                              sizeof(bf_pgo_entry_t), compare_entry);
+        if (entry) {
+            node->profile_samples = entry->samples > (uint64_t)INT32_MAX ? INT32_MAX : (int)entry->samples;
+            node->profile_entries = entry->entries;
+            node->profile_iterations = entry->iterations;
+            node->profiled = true;
+        }
+        if (ast_has_body(node)) {
+            bf_pgo_annotate(pgo, node->data.loop.body);
+        }
+    }
+}
+
+bool bf_pgo_hot(const bf_pgo_t *pgo, const ast_node_t *node) {
+    return pgo && node->profiled && node->profile_iterations > 0 &&
+           node->profile_iterations >= pgo->total_iterations / BF_PGO_HOT_SHARE;
+}
+
+bool bf_pgo_cold(const bf_pgo_t *pgo, const ast_node_t *node) {
+    return pgo && node->profiled && node->profile_entries == 0;
+}
+
+void bf_pgo_free(bf_pgo_t *pgo) {
+    free(pgo->entries);
+    memset(pgo, 0, sizeof(*pgo));
+}
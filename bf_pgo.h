@@ -0,0 +1,41 @@
+#ifndef BF_PGO_H
+#define BF_PGO_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+
+// A loop is hot when it runs at least 1/BF_PGO_HOT_SHARE of all loop
+// iterations in the training run
+#define BF_PGO_HOT_SHARE 64
+
+// Profile from a training run (--pgo-out), read back with --pgo-in. One
+// record per node, keyed by source location and node type, so it applies
+// to any build of the same source with the same optimization flags.
+typedef struct {
+    int line, column;
+    ast_node_type_t type;
+    uint64_t samples;           // SIGPROF samples attributed to the node
+    uint64_t entries;           // LOOP/IF: times reached
+    uint64_t iterations;        // LOOP/IF: times the body ran
+} bf_pgo_entry_t;
+
+typedef struct {
+    bf_pgo_entry_t *entries;    // Sorted by location and type
+    int entry_count;
+    uint64_t total_iterations;  // Sum over all loops, for BF_PGO_HOT_SHARE
+    uint64_t hash;              // Of the file contents (part of the code cache key)
+} bf_pgo_t;
+
+// Profile functions. Load returns 0 on success, -1 if the file is missing
+// or malformed; write returns 0 on success, -1 on I/O errors.
+int bf_pgo_load(bf_pgo_t *pgo, const char *path);
+int bf_pgo_write(ast_node_t *ast, const char *path);
+void bf_pgo_annotate(const bf_pgo_t *pgo, ast_node_t *ast);
+void bf_pgo_free(bf_pgo_t *pgo);
+
+// Codegen queries on an annotated tree
+bool bf_pgo_hot(const bf_pgo_t *pgo, const ast_node_t *node);
+bool bf_pgo_cold(const bf_pgo_t *pgo, const ast_node_t *node);
+
+#endif // BF_PGO_H
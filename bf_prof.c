@@ -14,6 +14,16 @@ static bf_profiler_t *g_profiler = NULL;
 // Forward declarations
 static void dump_folded_ast_node(ast_node_t *node, FILE *out, const char *stack_prefix);
 
+// Credit a sample to the node whose code contains pc. Binary search over
+// the sorted debug map and one increment, so the signal handler can call
+// it too.
+static void prof_attribute(bf_profiler_t *prof, void *pc) {
+    debug_map_entry_t *entry = bf_debug_find_by_pc((bf_debug_info_t *)prof->debug_info, pc);
+    if (entry && entry->node) {
+        entry->node->profile_samples++;
+    }
+}
+
 // SIGPROF signal handler - samples the program counter
 static void prof_signal_handler(int sig, siginfo_t *info, void *context) {
     (void)sig;
@@ -42,45 +52,55 @@ static void prof_signal_handler(int sig, siginfo_t *info, void *context) {
 
     // Only sample if PC is within our JIT code region
     if (pc >= g_profiler->code_start && pc < g_profiler->code_end) {
-        g_profiler->sample_count++;
-        
-        // Directly increment AST node sample count
-        if (g_profiler->debug_info && g_profiler->ast_root) {
-            bf_debug_info_t *debug = (bf_debug_info_t *)g_profiler->debug_info;
-            debug_map_entry_t *entry = bf_debug_find_by_pc(debug, pc);
-            if (entry) {
-                ast_node_t *node = bf_prof_find_ast_node((ast_node_t *)g_profiler->ast_root, 
-                                                         entry->source_line, entry->source_column);
-                if (node) {
-                    node->profile_samples++;
-                }
-            }
+        bf_profiler_t *prof = g_profiler;
+        prof->sample_count++;
+        if (!prof->debug_info) return;
+
+        // Single producer ring: the handler owns ring_head, the consumer
+        // publishes ring_tail. When it is full, attribute right away
+        // instead of dropping the sample.
+        size_t head = prof->ring_head;
+        size_t tail = __atomic_load_n(&prof->ring_tail, __ATOMIC_ACQUIRE);
+        if (head - tail < PROF_RING_SIZE) {
+            prof->ring[head % PROF_RING_SIZE] = pc;
+            __atomic_store_n(&prof->ring_head, head + 1, __ATOMIC_RELEASE);
+        } else {
+            prof_attribute(prof, pc);
         }
     }
 }
 
-ast_node_t* bf_prof_find_ast_node(ast_node_t *node, int line, int column) {
-    if (!node) return NULL;
-    
-    if (node->line == line && node->column == column) {
-        return node;
-    }
-    
-    // Search in loop body
-    if (node->type == AST_LOOP && node->data.loop.body) {
-        ast_node_t *found = bf_prof_find_ast_node(node->data.loop.body, line, column);
-        if (found) return found;
+// Attribute every buffered PC. Runs outside the handler; while the timer
+// is live it only ever consumes slots the handler has published.
+void bf_prof_drain(bf_profiler_t *prof) {
+    if (!prof->ring) return;
+
+    size_t head = __atomic_load_n(&prof->ring_head, __ATOMIC_ACQUIRE);
+    size_t tail = prof->ring_tail;
+    for (; tail != head; tail++) {
+        prof_attribute(prof, prof->ring[tail % PROF_RING_SIZE]);
     }
-    
-    // Search in next sibling
-    if (node->next) {
-        return bf_prof_find_ast_node(node->next, line, column);
+    __atomic_store_n(&prof->ring_tail, tail, __ATOMIC_RELEASE);
+}
+
+ast_node_t* bf_prof_find_ast_node(ast_node_t *node, int line, int column) {
+    // Walk siblings iteratively; only loop bodies recurse
+    for (; node; node = node->next) {
+        if (node->line == line && node->column == column) {
+            return node;
+        }
+
+        // Search in loop body
+        if (ast_has_body(node)) {
+            ast_node_t *found = bf_prof_find_ast_node(node->data.loop.body, line, column);
+            if (found) return found;
+        }
     }
-    
+
     return NULL;
 }
 
-int bf_prof_init(bf_profiler_t *prof, void *code_start, size_t code_size, void *debug_info, void *ast_root) {
+int bf_prof_init(bf_profiler_t *prof, void *code_start, size_t code_size, void *debug_info, void *ast_root, int sample_hz) {
     memset(prof, 0, sizeof(*prof));
 
     prof->sample_count = 0;
@@ -89,40 +109,54 @@ int bf_prof_init(bf_profiler_t *prof, void *code_start, size_t code_size, void *
     prof->enabled = false;
     prof->debug_info = debug_info;
     prof->ast_root = ast_root;
+    prof->sample_hz = sample_hz > 0 ? sample_hz : PROF_SAMPLE_RATE_HZ;
+
+    if (debug_info) {
+        prof->ring = malloc(PROF_RING_SIZE * sizeof(void *));
+        if (!prof->ring || bf_debug_resolve_nodes((bf_debug_info_t *)debug_info, (ast_node_t *)ast_root) != 0) {
+            free(prof->ring);
+            prof->ring = NULL;
+            return -1;
+        }
+    }
 
     return 0;
 }
 
-void bf_prof_start(bf_profiler_t *prof) {
-    if (prof->enabled) return;
+int bf_prof_start(bf_profiler_t *prof) {
+    if (prof->enabled) return 0;
 
     g_profiler = prof;
 
     // Install SIGPROF signal handler
-    struct sigaction sa;
+    struct sigaction sa, old_sa;
     sa.sa_sigaction = prof_signal_handler;
     sigemptyset(&sa.sa_mask);
     sa.sa_flags = SA_SIGINFO | SA_RESTART;
-    if (sigaction(SIGPROF, &sa, NULL) == -1) {
+    if (sigaction(SIGPROF, &sa, &old_sa) == -1) {
         fprintf(stderr, "Failed to install SIGPROF handler\n");
-        return;
+        g_profiler = NULL;
+        return -1;
     }
 
-    // Configure timer to generate SIGPROF at specified rate
+    // Configure timer to generate SIGPROF at specified rate. tv_usec must
+    // stay below one second, so 1 Hz is a whole second and no microseconds.
     struct itimerval timer;
-    timer.it_value.tv_sec = 0;
-    timer.it_value.tv_usec = 1000000 / PROF_SAMPLE_RATE_HZ;  // Interval for first signal
-    timer.it_interval.tv_sec = 0;
-    timer.it_interval.tv_usec = 1000000 / PROF_SAMPLE_RATE_HZ;  // Interval for subsequent signals
+    timer.it_interval.tv_sec = 1 / prof->sample_hz;
+    timer.it_interval.tv_usec = (1000000 / prof->sample_hz) % 1000000;
+    timer.it_value = timer.it_interval;  // First signal after one interval
 
     if (setitimer(ITIMER_PROF, &timer, NULL) == -1) {
         fprintf(stderr, "Failed to start profiling timer\n");
-        return;
+        sigaction(SIGPROF, &old_sa, NULL);
+        g_profiler = NULL;
+        return -1;
     }
 
     prof->enabled = true;
     fprintf(stderr, "Profiler started: sampling at %d Hz, code region %p-%p\n", 
-            PROF_SAMPLE_RATE_HZ, prof->code_start, prof->code_end);
+            prof->sample_hz, prof->code_start, prof->code_end);
+    return 0;
 }
 
 void bf_prof_stop(bf_profiler_t *prof) {
@@ -142,6 +176,8 @@ void bf_prof_stop(bf_profiler_t *prof) {
     prof->enabled = false;
     g_profiler = NULL;
 
+    bf_prof_drain(prof);
+
     fprintf(stderr, "Profiler stopped: collected %d samples\n", prof->sample_count);
 }
 
@@ -151,6 +187,8 @@ void bf_prof_cleanup(bf_profiler_t *prof) {
     }
 
     prof->sample_count = 0;
+    free(prof->ring);
+    prof->ring = NULL;
 }
 
 void bf_prof_dump_folded(bf_profiler_t *prof, FILE *out) {
@@ -176,7 +214,7 @@ static void dump_folded_ast_node(ast_node_t *node, FILE *out, const char *stack_
     snprintf(current_entry, sizeof(current_entry), "@%5d:%5d %s", 
              node->line, node->column, debug_node_type_name(node->type));
     
-    if (node->type == AST_LOOP) {
+    if (node->type == AST_LOOP || node->type == AST_IF) {
         // Build new stack with this loop added
         char new_stack[2048];
         if (strlen(stack_prefix) > 0) {
@@ -8,7 +8,9 @@
 #include "bf_ast.h"
 
 // Profiler configuration
-#define PROF_SAMPLE_RATE_HZ 1000
+#define PROF_SAMPLE_RATE_HZ 1000        // Default for --profile-hz
+#define PROF_MAX_SAMPLE_RATE_HZ 100000
+#define PROF_RING_SIZE 65536            // Raw PCs buffered before the handler attributes in place
 
 // Profiler state
 typedef struct {
@@ -18,12 +20,19 @@ typedef struct {
     bool enabled;               // Profiler enabled flag
     void *debug_info;           // Debug info for PC-to-AST mapping
     void *ast_root;             // AST root for direct sample counting
+    int sample_hz;              // SIGPROF rate
+    void **ring;                // Raw PCs recorded by the signal handler
+    size_t ring_head;           // Next slot the handler writes
+    size_t ring_tail;           // Next slot bf_prof_drain reads
 } bf_profiler_t;
 
-// Profiler functions
-int bf_prof_init(bf_profiler_t *prof, void *code_start, size_t code_size, void *debug_info, void *ast_root);
-void bf_prof_start(bf_profiler_t *prof);
+// Profiler functions. SIGPROF and its interval timer are per process, so
+// only one profiler can be started at a time (bf_lib.h never starts one).
+// bf_prof_start returns -1, with the old handler back, if either fails.
+int bf_prof_init(bf_profiler_t *prof, void *code_start, size_t code_size, void *debug_info, void *ast_root, int sample_hz);
+int bf_prof_start(bf_profiler_t *prof);
 void bf_prof_stop(bf_profiler_t *prof);
+void bf_prof_drain(bf_profiler_t *prof);
 void bf_prof_dump_folded(bf_profiler_t *prof, FILE *out);
 void bf_prof_cleanup(bf_profiler_t *prof);
 
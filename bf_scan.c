@@ -0,0 +1,298 @@
+#define _GNU_SOURCE
+#include "bf_scan.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+// Folded runs are split before their count could overflow an int
+#define SCAN_MAX_RUN (1 << 30)
+
+// Bytes the scanner has to look at: the commands, and newlines for the
+// line and column of each node
+static const bool scan_stop[256] = {
+    ['+'] = true, [','] = true, ['-'] = true, ['.'] = true,
+    ['<'] = true, ['>'] = true, ['['] = true, [']'] = true,
+    ['!'] = true, ['\n'] = true,
+};
+
+// Next byte at or after p the scanner stops at, or end. Generated sources
+// are mostly comments and indentation, so whole 16-byte blocks without a
+// command are skipped with one compare per command character.
+static const unsigned char *skip_comments(const unsigned char *p, const unsigned char *end) {
+    if (p < end && scan_stop[*p]) return p;
+
+#if defined(__SSE2__)
+    // '+' ',' '-' '.' are consecutive, so one range check covers them
+    const __m128i base = _mm_set1_epi8('+');
+    const __m128i span = _mm_set1_epi8(3);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)p);
+        __m128i t = _mm_sub_epi8(v, base);
+        __m128i hits = _mm_cmpeq_epi8(_mm_min_epu8(t, span), t);
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8('[')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8(']')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8('!')));
+        hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+        int mask = _mm_movemask_epi8(hits);
+        if (mask) return p + __builtin_ctz((unsigned)mask);
+        p += 16;
+    }
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+    const uint8x16_t base = vdupq_n_u8('+');
+    const uint8x16_t span = vdupq_n_u8(3);
+    while (end - p >= 16) {
+        uint8x16_t v = vld1q_u8(p);
+        uint8x16_t hits = vcleq_u8(vsubq_u8(v, base), span);
+        hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8('<')));
+        hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8('>')));
+        hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8('[')));
+        hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8(']')));
+        hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8('!')));
+        hits = vorrq_u8(hits, vceqq_u8(v, vdupq_n_u8('\n')));
+        if (vmaxvq_u8(hits)) break;     // The scalar loop finds it within 16 bytes
+        p += 16;
+    }
+#endif
+
+    while (p < end && !scan_stop[*p]) p++;
+    return p;
+}
+
+typedef struct {
+    ast_node_t *loop;           // Open loop, NULL for the top level
+    ast_node_t **tail;          // Where the next node of this list is linked
+} scan_frame_t;
+
+typedef struct {
+    scan_frame_t *frames;
+    int depth;                  // Open loops (frames[0] is the top level)
+    int capacity;
+    bool fold_runs;
+    ast_node_type_t run_type;   // Pending +- or <> run (with fold_runs)
+    long run_count;
+    int run_line, run_column;   // Where the run started, line 0 if none
+} scan_state_t;
+
+static void scan_append(scan_state_t *state, ast_node_t *node) {
+    scan_frame_t *frame = &state->frames[state->depth];
+    *frame->tail = node;
+    frame->tail = &node->next;
+}
+
+static void scan_flush_run(scan_state_t *state) {
+    if (state->run_line == 0) return;
+
+    long count = state->run_count;
+    ast_node_t *node = state->run_type == AST_MOVE_PTR
+        ? ast_create_move((int)count) : ast_create_add((int)count, 0);
+    ast_set_location(node, state->run_line, state->run_column);
+    scan_append(state, node);
+    state->run_line = 0;
+    state->run_count = 0;
+}
+
+static void scan_run(scan_state_t *state, ast_node_type_t type, int delta, int line, int column) {
+    if (!state->fold_runs) {
+        ast_node_t *node = type == AST_MOVE_PTR ? ast_create_move(delta) : ast_create_add(delta, 0);
+        ast_set_location(node, line, column);
+        scan_append(state, node);
+        return;
+    }
+    if (state->run_line != 0 &&
+        (state->run_type != type || labs(state->run_count) >= SCAN_MAX_RUN)) {
+        scan_flush_run(state);
+    }
+    if (state->run_line == 0) {
+        state->run_type = type;
+        state->run_line = line;
+        state->run_column = column;
+    }
+    state->run_count += delta;
+
+    // The rle pass drops a run as soon as it cancels out and starts the
+    // next one fresh, which decides the location the merged node keeps
+    if (state->run_type == AST_MOVE_PTR ? state->run_count == 0 : (state->run_count & 0xFF) == 0) {
+        state->run_line = 0;
+        state->run_count = 0;
+    }
+}
+
+static void scan_node(scan_state_t *state, ast_node_t *node, int line, int column) {
+    scan_flush_run(state);
+    ast_set_location(node, line, column);
+    scan_append(state, node);
+}
+
+static void scan_error(char *error, size_t error_size, int line, int column, const char *msg) {
+    if (error && error_size > 0) {
+        snprintf(error, error_size, "Parse error at line %d, column %d: %s", line, column, msg);
+    }
+}
+
+int bf_scan(const char *source, size_t size, bool fold_runs, ast_node_t **result, char *error, size_t error_size) {
+    ast_node_t *root = NULL;
+    scan_state_t state = { .fold_runs = fold_runs };
+
+    *result = NULL;
+    if (error && error_size > 0) {
+        error[0] = '\0';
+    }
+
+    state.capacity = 64;
+    state.frames = malloc((size_t)state.capacity * sizeof(scan_frame_t));
+    if (!state.frames) {
+        if (error && error_size > 0) {
+            snprintf(error, error_size, "Memory allocation failed");
+        }
+        return -1;
+    }
+    state.frames[0].loop = NULL;
+    state.frames[0].tail = &root;
+
+    const unsigned char *p = (const unsigned char *)source;
+    const unsigned char *end = p + size;
+    const unsigned char *line_start = p;
+    int line = 1;
+
+    while ((p = skip_comments(p, end)) < end) {
+        int column = (int)(p - line_start) + 1;
+
+        switch (*p) {
+            case '\n':
+                line++;
+                line_start = p + 1;
+                break;
+            case '>': scan_run(&state, AST_MOVE_PTR, 1, line, column); break;
+            case '<': scan_run(&state, AST_MOVE_PTR, -1, line, column); break;
+            case '+': scan_run(&state, AST_ADD_VAL, 1, line, column); break;
+            case '-': scan_run(&state, AST_ADD_VAL, -1, line, column); break;
+            case '.': scan_node(&state, ast_create_output(0), line, column); break;
+            case ',': scan_node(&state, ast_create_input(0), line, column); break;
+            case '!': scan_node(&state, ast_create_debug_log(), line, column); break;
+            case '[': {
+                ast_node_t *loop = ast_create_loop(NULL);
+                scan_node(&state, loop, line, column);
+                if (state.depth + 1 == state.capacity) {
+                    state.capacity *= 2;
+                    scan_frame_t *grown = realloc(state.frames, (size_t)state.capacity * sizeof(scan_frame_t));
+                    if (!grown) {
+                        free(state.frames);
+                        if (error && error_size > 0) {
+                            snprintf(error, error_size, "Memory allocation failed");
+                        }
+                        return -1;
+                    }
+                    state.frames = grown;
+                }
+                state.depth++;
+                state.frames[state.depth].loop = loop;
+                state.frames[state.depth].tail = &loop->data.loop.body;
+                break;
+            }
+            case ']':
+                scan_flush_run(&state);
+                if (state.depth == 0) {
+                    free(state.frames);
+                    scan_error(error, error_size, line, column, "unmatched ']'");
+                    return -1;
+                }
+                state.depth--;
+                break;
+        }
+        p++;
+    }
+    scan_flush_run(&state);
+
+    if (state.depth > 0) {
+        ast_node_t *open = state.frames[state.depth].loop;
+        free(state.frames);
+        scan_error(error, error_size, open->line, open->column, "unmatched '['");
+        return -1;
+    }
+
+    free(state.frames);
+    *result = root;
+    return 0;
+}
+
+int bf_source_open(bf_source_t *source, const char *path) {
+    source->data = NULL;
+    source->size = 0;
+    source->mapped = false;
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return -1;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+        if (st.st_size == 0) {
+            close(fd);
+            return 0;
+        }
+        void *data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+            close(fd);
+            source->data = data;
+            source->size = (size_t)st.st_size;
+            source->mapped = true;
+            return 0;
+        }
+    }
+
+    // Not mappable: read it all
+    size_t capacity = 0;
+    char *data = NULL;
+    for (;;) {
+        if (source->size == capacity) {
+            capacity = capacity ? capacity * 2 : 65536;
+            char *grown = realloc(data, capacity);
+            if (!grown) {
+                free(data);
+                close(fd);
+                errno = ENOMEM;
+                return -1;
+            }
+            data = grown;
+        }
+        ssize_t n = read(fd, data + source->size, capacity - source->size);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            int saved = errno;
+            free(data);
+            close(fd);
+            source->size = 0;
+            errno = saved;
+            return -1;
+        }
+        if (n == 0) break;
+        source->size += (size_t)n;
+    }
+    close(fd);
+    source->data = data;
+    return 0;
+}
+
+void bf_source_close(bf_source_t *source) {
+    if (source->mapped) {
+        munmap((void *)source->data, source->size);
+    } else {
+        free((void *)source->data);
+    }
+    source->data = NULL;
+    source->size = 0;
+    source->mapped = false;
+}
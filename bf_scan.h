@@ -0,0 +1,29 @@
+#ifndef BF_SCAN_H
+#define BF_SCAN_H
+
+#include <stddef.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+
+// Direct source scanner: builds the AST in one pass over the bytes,
+// skipping comments 16 bytes at a time. Every command becomes one node
+// with its line and column; with fold_runs, runs of +- and <> are merged
+// as the rle pass would, so only use it when rle runs afterwards.
+typedef struct {
+    const char *data;
+    size_t size;
+    bool mapped;                // data is an mmap of the file, else malloc'd
+} bf_source_t;
+
+// Source functions. Regular files are mapped read-only rather than copied;
+// anything else (pipes, /dev/stdin) is read into memory. open returns -1
+// with errno set if the file cannot be read.
+int bf_source_open(bf_source_t *source, const char *path);
+void bf_source_close(bf_source_t *source);
+
+// Scan size bytes of source (need not be NUL-terminated). Returns 0, or -1
+// with the reason in error (if not NULL); *result is NULL for an empty
+// program or on failure.
+int bf_scan(const char *source, size_t size, bool fold_runs, ast_node_t **result, char *error, size_t error_size);
+
+#endif // BF_SCAN_H
@@ -0,0 +1,168 @@
+#define _GNU_SOURCE
+#include "bf_stats.h"
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define STATS_MINCORE_PAGES 4096    // Pages asked about per mincore call
+
+void bf_stats_init(bf_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+}
+
+void bf_stats_phase(bf_stats_t *stats, const char *name, double ms) {
+    if (stats->phase_count == BF_STATS_MAX_PHASES) return;
+    stats->phases[stats->phase_count++] = (bf_stats_phase_t){ name, ms };
+}
+
+// Deepest nesting of LOOP and IF bodies below node
+static int loop_depth(ast_node_t *node) {
+    int depth = 0;
+
+    for (; node; node = node->next) {
+        if (!ast_has_body(node)) continue;
+        int inner = 1 + loop_depth(node->data.loop.body);
+        if (inner > depth) depth = inner;
+    }
+
+    return depth;
+}
+
+void bf_stats_tree(bf_stats_t *stats, ast_node_t *ast) {
+    stats->compiled = true;
+    memset(stats->compiled_nodes, 0, sizeof(stats->compiled_nodes));
+    ast_count_types(ast, stats->compiled_nodes);
+    stats->max_loop_depth = loop_depth(ast);
+    // Same budget as bf_codegen_compile: two labels per loop, one per IF
+    stats->loop_labels = stats->compiled_nodes[AST_LOOP] * 2 + stats->compiled_nodes[AST_IF];
+}
+
+// Each node's code runs from its label to the next label in address
+// order, or to the epilogue or cold section if one starts first. The
+// cold section (slow copies of blocks, I/O calls) is counted on its own.
+void bf_stats_code(bf_stats_t *stats, const bf_debug_info_t *debug, size_t code_size) {
+    stats->has_code = true;
+    stats->code_size = code_size;
+    memset(stats->code_bytes, 0, sizeof(stats->code_bytes));
+    stats->code_entry_bytes = code_size;
+    stats->code_exit_bytes = 0;
+    stats->code_cold_bytes = 0;
+    stats->debug_labels = debug ? debug->entry_count : 0;
+    if (!debug) return;
+
+    if (debug->cold_offset > 0 && debug->cold_offset <= code_size) {
+        stats->code_cold_bytes = code_size - debug->cold_offset;
+    }
+    if (debug->exit_offset > 0) {
+        stats->code_exit_bytes = bf_debug_region_end(debug, debug->exit_offset) - debug->exit_offset;
+    }
+    stats->code_entry_bytes = bf_debug_region_end(debug, 0);
+
+    for (int i = 0; i < debug->entry_count; i++) {
+        const debug_map_entry_t *entry = &debug->entries[i];
+        size_t end = bf_debug_entry_end(debug, i);
+        if (entry->node_type < AST_TYPE_COUNT && end > entry->pc_offset) {
+            stats->code_bytes[entry->node_type] += end - entry->pc_offset;
+        }
+    }
+}
+
+// A page is resident once the program has read or written it: the tape is
+// mapped fresh and never touched by anything else
+void bf_stats_tape(bf_stats_t *stats, char *region, size_t size, const char *start) {
+    size_t page_size = (size_t)getpagesize();
+    unsigned char vec[STATS_MINCORE_PAGES];
+    bool touched = false;
+
+    stats->has_run = true;
+    stats->tape_size = size;
+    stats->tape_touched = 0;
+    stats->tape_low = stats->tape_high = 0;
+
+    size_t pages = (size + page_size - 1) / page_size;
+    for (size_t first = 0; first < pages; first += STATS_MINCORE_PAGES) {
+        size_t n = pages - first < STATS_MINCORE_PAGES ? pages - first : STATS_MINCORE_PAGES;
+        char *at = region + first * page_size;
+        if (mincore(at, n * page_size, (void *)vec) != 0) return;
+
+        for (size_t i = 0; i < n; i++) {
+            if (!(vec[i] & 1)) continue;
+            char *page = at + i * page_size;
+            long low = (long)(page - start);
+            long high = (long)(page + page_size - start);
+            if (!touched || low < stats->tape_low) stats->tape_low = low;
+            if (!touched || high > stats->tape_high) stats->tape_high = high;
+            stats->tape_touched += page_size;
+            touched = true;
+        }
+    }
+}
+
+// {"MOVE_PTR": n, ...} over every node type
+static void write_json_types(const char *key, const int *counts, FILE *out) {
+    fprintf(out, "\"%s\": {", key);
+    for (int t = 0; t < AST_TYPE_COUNT; t++) {
+        fprintf(out, "%s\"%s\": %d", t ? ", " : "", debug_node_type_name((ast_node_type_t)t), counts[t]);
+    }
+    fprintf(out, "}");
+}
+
+int bf_stats_write_json(const bf_stats_t *stats, FILE *out) {
+    fprintf(out, "{\n  \"phases\": {");
+    for (int i = 0; i < stats->phase_count; i++) {
+        fprintf(out, "%s\"%s\": %.3f", i ? ", " : "", stats->phases[i].name, stats->phases[i].ms);
+    }
+    fprintf(out, "},\n  \"total_ms\": %.3f,\n", stats->total_ms);
+
+    fprintf(out, "  \"passes\": ");
+    if (stats->optimized) {
+        fprintf(out, "[");
+        for (int p = 0; p < stats->pass_count; p++) {
+            const ast_pass_stats_t *ps = &stats->pass_stats[p];
+            fprintf(out, "%s\n    {\"name\": \"%s\", \"ms\": %.3f, \"fired\": %ld, ",
+                    p ? "," : "", stats->passes[p]->name, ps->ms, ps->fired);
+            write_json_types("before", ps->nodes_before, out);
+            fprintf(out, ", ");
+            write_json_types("after", ps->nodes_after, out);
+            fprintf(out, "}");
+        }
+        fprintf(out, stats->pass_count ? "\n  ],\n" : "],\n");
+    } else {
+        fprintf(out, "null,\n");
+    }
+
+    fprintf(out, "  \"tree\": ");
+    if (stats->compiled) {
+        fprintf(out, "{");
+        write_json_types("parsed", stats->parsed_nodes, out);
+        fprintf(out, ", ");
+        write_json_types("compiled", stats->compiled_nodes, out);
+        fprintf(out, ", \"max_loop_depth\": %d},\n", stats->max_loop_depth);
+    } else {
+        fprintf(out, "null,\n");
+    }
+
+    fprintf(out, "  \"code\": ");
+    if (stats->has_code) {
+        fprintf(out, "{\"size\": %zu, \"entry\": %zu, \"exit\": %zu, \"cold\": %zu, \"bytes\": {",
+                stats->code_size, stats->code_entry_bytes, stats->code_exit_bytes, stats->code_cold_bytes);
+        for (int t = 0; t < AST_TYPE_COUNT; t++) {
+            fprintf(out, "%s\"%s\": %zu", t ? ", " : "", debug_node_type_name((ast_node_type_t)t), stats->code_bytes[t]);
+        }
+        fprintf(out, "}, \"labels\": {\"loop\": %d, \"debug\": %d}},\n", stats->loop_labels, stats->debug_labels);
+    } else {
+        fprintf(out, "null,\n");
+    }
+
+    fprintf(out, "  \"run\": ");
+    if (stats->has_run) {
+        fprintf(out, "{\"tape_size\": %zu, \"tape_touched\": %zu, \"tape_low\": %ld, \"tape_high\": %ld, "
+                "\"tape_committed\": %zu, \"bytes_read\": %zu, \"bytes_written\": %zu}\n",
+                stats->tape_size, stats->tape_touched, stats->tape_low, stats->tape_high,
+                stats->tape_committed, stats->bytes_read, stats->bytes_written);
+    } else {
+        fprintf(out, "null\n");
+    }
+
+    return fprintf(out, "}\n") < 0 || ferror(out) ? -1 : 0;
+}
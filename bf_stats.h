@@ -0,0 +1,65 @@
+#ifndef BF_STATS_H
+#define BF_STATS_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "bf_ast.h"
+#include "bf_debug.h"
+
+#define BF_STATS_MAX_PHASES 16
+
+// Compile pipeline and run metrics for --stats=json, collected as the
+// command line tool goes and written out once at exit. Sections that did
+// not happen in this run (no optimizer, no JIT code, batch runs) are null.
+typedef struct {
+    const char *name;
+    double ms;
+} bf_stats_phase_t;
+
+typedef struct {
+    bf_stats_phase_t phases[BF_STATS_MAX_PHASES];   // In the order they ran
+    int phase_count;
+    double total_ms;
+
+    // Optimizer: one entry per pass of the pipeline
+    bool optimized;
+    const ast_pass_t **passes;
+    ast_pass_stats_t *pass_stats;
+    int pass_count;
+    int parsed_nodes[AST_TYPE_COUNT];       // Tree as parsed
+    bool compiled;
+    int compiled_nodes[AST_TYPE_COUNT];     // Tree handed to the code generator
+    int max_loop_depth;
+    int loop_labels;                        // PC labels of loops and ifs
+
+    // Code: bytes from each node's debug label to the next one
+    bool has_code;
+    size_t code_size;
+    size_t code_bytes[AST_TYPE_COUNT];
+    size_t code_entry_bytes;                // Before the first label: prologue, partial evaluation
+    size_t code_exit_bytes;                 // Epilogue
+    size_t code_cold_bytes;                 // Cold section (amd64): block slow copies, I/O calls
+    int debug_labels;
+
+    // Run: tape pages the program touched, as offsets from the initial cell
+    bool has_run;
+    size_t tape_size;
+    size_t tape_touched;
+    long tape_low, tape_high;
+    size_t tape_committed;                  // --tape=grow only
+    size_t bytes_read, bytes_written;
+} bf_stats_t;
+
+// Stats functions. tree records the compiled tree's counts and shape,
+// code splits the code by the debug map (sorted, offsets resolved), tape
+// scans the size bytes of tape at region for resident pages.
+void bf_stats_init(bf_stats_t *stats);
+void bf_stats_phase(bf_stats_t *stats, const char *name, double ms);
+void bf_stats_tree(bf_stats_t *stats, ast_node_t *ast);
+void bf_stats_code(bf_stats_t *stats, const bf_debug_info_t *debug, size_t code_size);
+void bf_stats_tape(bf_stats_t *stats, char *region, size_t size, const char *start);
+int bf_stats_write_json(const bf_stats_t *stats, FILE *out);
+
+#endif // BF_STATS_H
@@ -0,0 +1,166 @@
+#define _GNU_SOURCE
+#include "bf_tape.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+// Tapes the fault handler grows, scanned without locks from the handler;
+// slots are claimed and cleared with atomics
+static bf_tape_t *tape_registry[BF_TAPE_MAX];
+static struct sigaction previous_segv, previous_bus;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+static int handler_error;
+
+static void tape_die(const char *msg, size_t size) {
+    ssize_t ignored = write(STDERR_FILENO, msg, size);
+    (void)ignored;
+    _exit(1);
+}
+
+static void tape_fault(int sig, siginfo_t *info, void *context) {
+    char *addr = info->si_addr;
+    (void)context;
+
+    for (int i = 0; i < BF_TAPE_MAX; i++) {
+        bf_tape_t *tape = __atomic_load_n(&tape_registry[i], __ATOMIC_ACQUIRE);
+        if (!tape || addr < tape->region || addr >= tape->region + tape->size) continue;
+
+        if (addr < tape->region + tape->chunk || addr >= tape->region + tape->size - tape->chunk) {
+            static const char msg[] = "Error: Tape limit reached (raise --memory)\n";
+            tape_die(msg, sizeof(msg) - 1);
+        }
+        // mprotect is not on the async-signal-safe list, but it is a plain
+        // system call; the faulting access is retried on return
+        char *chunk = tape->region + ((size_t)(addr - tape->region) & ~(tape->chunk - 1));
+        if (mprotect(chunk, tape->chunk, PROT_READ | PROT_WRITE) != 0) {
+            static const char msg[] = "Error: Could not grow the tape\n";
+            tape_die(msg, sizeof(msg) - 1);
+        }
+        __atomic_add_fetch(&tape->committed, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    // Not a tape: hand the fault back to whoever had it, which crashes
+    // here as it would have without us when the access is retried
+    sigaction(sig, sig == SIGBUS ? &previous_bus : &previous_segv, NULL);
+}
+
+static void install_handler(void) {
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_sigaction = tape_fault;
+    sa.sa_flags = SA_SIGINFO | SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    // macOS reports access to a PROT_NONE page as SIGBUS
+    if (sigaction(SIGSEGV, &sa, &previous_segv) != 0 || sigaction(SIGBUS, &sa, &previous_bus) != 0) {
+        handler_error = errno;
+    }
+}
+
+// PROT_NONE reservation of the tape; commit happens in the handler
+static int tape_map(bf_tape_t *tape, int flags) {
+    void *mapping = mmap(tape->mapping, tape->mapping_size, PROT_NONE, flags, -1, 0);
+    if (mapping == MAP_FAILED) return -1;
+    tape->mapping = mapping;
+    tape->flags = flags;
+    return 0;
+}
+
+int bf_tape_reserve(bf_tape_t *tape, size_t size, size_t offset, bool huge) {
+    memset(tape, 0, sizeof(*tape));
+
+    pthread_once(&handler_once, install_handler);
+    if (handler_error) {
+        errno = handler_error;
+        return -1;
+    }
+
+    // Whole chunks, a guard chunk at either end, and the initial cell
+    // mid-way unless the offset asks for more room below it
+    tape->chunk = huge ? BF_TAPE_HUGE_CHUNK : BF_TAPE_CHUNK;
+    size_t chunk = tape->chunk;
+    size_t below = offset > size / 2 ? offset : size / 2;
+    below = (below + chunk - 1) & ~(chunk - 1);
+    size_t above = size > below ? size - below : 0;
+    above = (above + chunk - 1) & ~(chunk - 1);
+    if (above < chunk) above = chunk;
+    tape->size = chunk + below + above + chunk;
+
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE;
+    int hugetlb = -1;
+#ifdef MAP_HUGETLB
+    // Reserving huge pages up front only succeeds when the pool can back
+    // the whole tape; the reservation is exact, so no alignment slack
+    if (huge) {
+        tape->mapping_size = tape->size;
+        hugetlb = tape_map(tape, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB);
+    }
+#endif
+    if (hugetlb != 0) {
+        // Slack to align the reservation to a chunk, which for huge pages
+        // lets the kernel back each committed chunk with one
+        tape->mapping = NULL;
+        tape->mapping_size = tape->size + chunk;
+        if (tape_map(tape, flags) != 0) return -1;
+    }
+    tape->region = (char *)(((uintptr_t)tape->mapping + chunk - 1) & ~(uintptr_t)(chunk - 1));
+    tape->start = tape->region + chunk + below;
+#ifdef MADV_HUGEPAGE
+    if (huge && hugetlb != 0) {
+        madvise(tape->mapping, tape->mapping_size, MADV_HUGEPAGE);
+    }
+#endif
+
+    for (int i = 0; i < BF_TAPE_MAX; i++) {
+        bf_tape_t *expected = NULL;
+        if (__atomic_compare_exchange_n(&tape_registry[i], &expected, tape, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+    }
+    munmap(tape->mapping, tape->mapping_size);
+    errno = EMFILE;
+    return -1;
+}
+
+void bf_tape_reset(bf_tape_t *tape) {
+    // Mapping the range afresh drops every committed page at once; the
+    // program commits what it touches again, zero-filled
+    if (mmap(tape->mapping, tape->mapping_size, PROT_NONE, tape->flags | MAP_FIXED, -1, 0) == MAP_FAILED) {
+        perror("Error: Could not reset the tape");
+        exit(1);
+    }
+#if defined(MADV_HUGEPAGE) && defined(MAP_HUGETLB)
+    if (tape->chunk == BF_TAPE_HUGE_CHUNK && !(tape->flags & MAP_HUGETLB)) {
+        madvise(tape->mapping, tape->mapping_size, MADV_HUGEPAGE);
+    }
+#endif
+    __atomic_store_n(&tape->committed, 0, __ATOMIC_RELAXED);
+}
+
+size_t bf_tape_committed(const bf_tape_t *tape) {
+    return __atomic_load_n(&tape->committed, __ATOMIC_RELAXED) * tape->chunk;
+}
+
+void bf_tape_release(bf_tape_t *tape) {
+    if (!tape->mapping) return;
+    for (int i = 0; i < BF_TAPE_MAX; i++) {
+        bf_tape_t *expected = tape;
+        if (__atomic_compare_exchange_n(&tape_registry[i], &expected, NULL, false,
+                                        __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+            break;
+        }
+    }
+    munmap(tape->mapping, tape->mapping_size);
+    memset(tape, 0, sizeof(*tape));
+}
@@ -0,0 +1,38 @@
+#ifndef BF_TAPE_H
+#define BF_TAPE_H
+
+#include <stddef.h>
+#include <stdbool.h>
+
+#define BF_TAPE_DEFAULT_RESERVE ((size_t)1 << 36)  // 64 GB of address space for --tape=grow
+#define BF_TAPE_CHUNK ((size_t)1 << 20)            // Commit granularity
+#define BF_TAPE_HUGE_CHUNK ((size_t)2 << 20)       // Commit granularity with huge pages
+#define BF_TAPE_MAX 512                            // Growable tapes alive at once
+
+// Growable tape (--tape=grow): address space reserved without access or
+// commit charge, and committed a chunk at a time by a SIGSEGV handler as
+// the program touches it. Compiled code runs in unsafe mode on it, with no
+// bounds check: the fault is the check. The initial cell sits in the
+// middle, so the pointer can move a long way in either direction; the
+// first and last chunk are never committed and stop a runaway program.
+typedef struct {
+    char *mapping;              // Whole mapping, including alignment slack
+    size_t mapping_size;
+    char *region;               // Chunk-aligned reservation
+    size_t size;
+    char *start;                // Initial cell
+    size_t chunk;
+    int flags;                  // mmap flags, to map the reservation afresh
+    size_t committed;           // Chunks committed so far
+} bf_tape_t;
+
+// Tape functions. reserve sets aside size bytes with at least offset of
+// them below the initial cell; huge backs the tape with MAP_HUGETLB pages
+// when the pool can hold it, else asks for transparent huge pages. Returns
+// 0, or -1 with errno set. reset zeroes the tape and returns its memory.
+int bf_tape_reserve(bf_tape_t *tape, size_t size, size_t offset, bool huge);
+void bf_tape_reset(bf_tape_t *tape);
+size_t bf_tape_committed(const bf_tape_t *tape);
+void bf_tape_release(bf_tape_t *tape);
+
+#endif // BF_TAPE_H